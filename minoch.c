@@ -15,14 +15,58 @@
 #include <fcntl.h>							//file control options
 #include <sys/ioctl.h>							//Input Output Control
 #include <sys/types.h>		
-#include <time.h>											
+#include <sys/stat.h>
+#include <sys/mman.h>							// mmap, to open big files without reading them
+#include <sys/uio.h>							// writev, to save many rows with one syscall
+#include <sys/resource.h>						// getrusage, for the peak memory we report after saving
+#include <libgen.h>							// dirname
+#include <pthread.h>							// worker threads for the background search (build with -pthread)
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>						// SIGWINCH as a file descriptor, so poll() can wait for it with the keys
+#include <sys/timerfd.h>						// status message expiry, same thing
+#include <sys/eventfd.h>						// search workers wake the main loop with it
+#include <stdint.h>
+#include <stddef.h>							// offsetof, for the long rows of Row memory
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>							// SSE2 / AVX2 intrinsics for the search kernel
+#endif
+#include <time.h>
+#include <sys/wait.h>							// --bench runs every scenario in its own child
+#include <sys/inotify.h>						// follow mode, see Follow mode
+#include <sys/file.h>							// flock, one editor per journal
 
 
 /**** Defines ****/ 
 
 #define MINOCH_VERSION "0.0.1"						//version 
+#define MINOCH_LONG_ROW (64 << 10)					// rows longer than that get a gap where we type, and only their visible part rendered
+#define MINOCH_LONG_GAP (64 << 10)					// size of that gap
 #define MINOCH_TAB_STOP 8				
+#define MINOCH_STATUS_SECONDS 5						// how long a status message stays on screen
+#define MINOCH_ESC_TIMEOUT_MS 100					// an escape not followed by the rest of a sequence within that is the ESC key
 #define MINOCH_QUIT_TIMES 2						// nb of times pressing ctrl-q to exit
+#define MINOCH_SAVE_BATCH 512						// nb of rows sent to the kernel per writev when saving
+#define MINOCH_SAVE_CLONE (256 << 10)					// unedited runs of the file at least that long are copied by the kernel when saving
+#define MINOCH_SEARCH_BLOCK 4096					// nb of rows a search worker grabs at once
+#define MINOCH_SEARCH_WAIT_MS 30					// how long a search key waits for the jump before letting the screen refresh
+#define MINOCH_REPLACE_ROWS 1024					// nb of rows a replace worker rewrites at once
+#define MINOCH_MAX_WORKERS 64
+#define MINOCH_SLAB_SIZE (256 << 10)					// the chars of the rows are cut from slabs of that size ...
+#define MINOCH_SLAB_MAX 16384						// ... up to that size, longer rows get their own malloc
+#define MINOCH_SLAB_CLASSES 21
+#define MINOCH_LOAD_CHUNK (4 << 20)					// the loader cuts the file in chunks of that size, one worker at a time on each
+#define MINOCH_FOLLOW_MS 20						// follow mode reads what was appended at most once per that many ms
+#define MINOCH_JOURNAL_MS 200						// edits reach the journal (written and fdatasync'ed) in batches, once per that many ms
+#define MINOCH_UNDO_LIMIT (64 << 20)					// max memory for the undo history, the oldest edits are dropped past that
+#define MINOCH_UNDO_CHUNK (64 << 10)					// the undo arena is allocated by chunks of this size (or more for big edits)
+#define MINOCH_UNDO_COALESCE 4096					// typed chars are merged in one undo record up to that many bytes
+#define MINOCH_INPUT_RING (64 << 10)					// size of the input ring buffer, a power of 2
+#define MINOCH_SYNTAX_GUESS 4096					// a row drawn further than that below the lexed rows gets its state from that many rows above
+#define MINOCH_SYNTAX_SLICE 16384					// nb of rows lexed at once while idle, to catch up after such a jump
+#define MINOCH_RENDER_CACHE 256						// min nb of rendered rows we keep around (the cache is never smaller than 2 screens)
+#define MINOCH_COLUMN_BYTES 16						// bytes a screen column can take once drawn (a utf-8 char and its color escapes), to size the frame buffers
 
 #define CTRL_KEY(k) ((k) & 0x1f)					
 // 0x1f = 00011111  : why we use and 0x1f becaus ctrl+key in terminal does the same, it takes binary of the key makes bit 5,6,7 to zero and sends the resulting byte  
@@ -36,7 +80,11 @@ enum editorKey{
   ARROW_UP,
   ARROW_DOWN,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  PASTE_START,								// bracketed paste : the terminal wraps pasted text in ESC[200~ .. ESC[201~
+  PASTE_END,
+  FILE_START,								// Ctrl-Home / Ctrl-End
+  FILE_END
 };
 
 
@@ -45,12 +93,309 @@ enum editorKey{
 
 typedef struct erow {					//editor row structure that will store our  txt lines
   int size;
-  int rsize;
-  char *chars;
-  char *render;						// for handling tabs 
+  int rslot;						// render cache slot that had this row last time it was drawn (may have been reused since)
+  char *chars;						// NULL as long as the row was not edited, its text is then still in the mapped file
+  off_t foff;						// where the row starts in E.map (only used while chars is NULL)
+  unsigned long long version;				// changes every time the row changes; a cached render is only valid for the same version
+  unsigned char hl_start, hl_end;			// lexer state at the start / end of the row (in a comment or not), see Syntax highlighting
+  unsigned char hl_ok;					// 0 when hl_end is unknown (new or edited row)
+  int ccap;						// bytes allocated for chars (there is room to grow in place until then), see Row memory
 } erow;
 
 
+struct tabStop {					// a tab or a non ASCII char of a row : where it is in chars, and the render column
+  int pos, rend;					// right after it ...
+  int rb;						// ... and the render byte (-1 in long rows, their render is a window)
+  unsigned char len, width, tab;			// its bytes in chars, its columns, 1 for a tab
+};
+
+
+struct renderSlot {					// a rendered row (tabs expanded) in the render cache
+  unsigned long long version;				// version of the row it was built from, 0 when unused
+  char *render;
+  int rsize;
+  int cap;
+  struct tabStop *tabs;					// the tabs of the row in order : cx <-> rx with a binary search, see editorRenderCxToRx
+  int ntabs, tabcap;
+  int nwide;						// stops that are not tabs : while 0, render bytes and columns go 1 to 1
+  int rstart, rcols;					// render holds the columns [rstart, rstart + rcols) of a long row, rcols 0 : the whole row,
+							// -1 : nothing (only the tab index is good)
+  unsigned char *hl;					// highlight of each render char (HL_xxx), valid if hlstate is the state the row starts in
+  int hlcap;
+  int hlstate;						// -1 when hl was not built for this render
+  int prev, next;					// LRU list, E.rlru_head is the most recently drawn
+};
+
+
+struct abuf {						//the buffer that will temporarly store what we want to write in the screen of our editor (like welcome msg for ex..)
+	char *b;
+	int len;
+	int cap;					// allocated size, kept from one frame to the next so redrawing doesn't allocate
+};
+
+#define ABUF_INIT {NULL, 0, 0}
+
+
+struct workerPool {					// threads running the same job together, see Worker pool
+  pthread_t *threads;
+  int nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;					// a new job was posted
+  pthread_cond_t idle;					// the last worker finished the job
+  void (*job)(int);
+  unsigned long gen;					// bumped for every job
+  int running;						// workers still busy with the current job
+};
+
+
+struct loadChunk {					// a piece of the file being loaded, see editorLoadRows
+  long nl;						// newlines in it
+  off_t last;						// offset of the last one, -1 if none
+  long row;						// index of the first row that ends in this chunk
+  off_t start;						// and where that row starts (maybe in an earlier chunk)
+};
+
+
+struct loadState {
+  struct loadChunk *chunks;
+  int nchunks;
+  int next;						// next chunk a worker takes (atomic)
+  int pass;						// 0 : count the newlines, 1 : fill the rows
+  unsigned long long version;				// row versions start after this one
+};
+
+
+enum searchBlockState { BLOCK_PENDING = 0, BLOCK_SCANNING, BLOCK_DONE };
+
+struct searchBlock {					// the results of the background search for a range of rows
+  int start, end;					// rows [start, end); they move when rows are inserted/deleted before them
+  int state;
+  int *m;						// the matches as pairs (row - start, col), in order
+  int n, cap;						// nb of matches, allocated pairs
+};
+
+
+struct searchState {
+  char *query;						// NULL when no search is running
+  int qlen;
+  struct searchBlock *blocks;
+  int nblocks;
+  int first;						// block the workers start from (where the cursor is), the rest follows in order
+  int next;						// next block to hand out to a worker (atomic)
+  int cancel;						// set to make the workers stop (atomic)
+  int done, shown_done;					// nb of blocks scanned, and that the screen knows about
+  long count;						// nb of matches found so far
+  int jump;						// 1 / -1 when we wait for the next / previous match from (jrow, jcol) to jump on it
+  int jrow, jcol;
+  pthread_mutex_t lock;					// protects everything above that workers write
+  pthread_cond_t progress;				// signaled every time a block is done
+};
+
+
+struct replaceRow {					// a row replace-all rewrites, see Replace
+  int row;
+  int first, n;						// its matches in the match list
+  int size;						// its size once replaced
+  char *chars;						// its new chars, allocated before the workers fill them
+  int ccap;
+};
+
+
+struct replaceState {
+  const char *from, *to;
+  int flen, tlen;
+  int pass;						// 0 : find the matches, 1 : write the new rows
+  struct searchBlock *blocks;				// pass 0 : matches of each block of rows, as (row, col)
+  int nblocks;
+  const int *m;						// pass 1 : all the matches, in order
+  struct replaceRow *rows;
+  int nrows;
+  int next;						// next block / rows a worker takes (atomic)
+  long long bytes;					// bytes scanned (atomic)
+  int threads;						// nb of threads the last pass ran on
+};
+
+
+enum editorHighlight {
+  HL_NORMAL = 0,
+  HL_COMMENT,
+  HL_MLCOMMENT,
+  HL_KEYWORD1,
+  HL_KEYWORD2,
+  HL_STRING,
+  HL_NUMBER
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1<<0)
+#define HL_HIGHLIGHT_STRINGS (1<<1)
+
+
+struct editorSyntax {					// how to highlight one kind of file
+  char *filetype;
+  char **filematch;					// ".ext" matches the extension, anything else a part of the file name
+  char **keywords;					// a trailing '|' makes it a type (KEYWORD2)
+  char *singleline_comment_start;
+  char *multiline_comment_start;			// a file type with these needs the row states, the others start every row fresh
+  char *multiline_comment_end;
+  int flags;
+};
+
+
+enum undoType { UNDO_INSERT = 1, UNDO_DELETE, UNDO_REPLACE };
+
+struct undoRec {					// one edit in the undo history : text inserted or deleted at (row, col)
+  int type;
+  int group;						// 1 on the first record of a user action, undo/redo go by whole actions
+  int row, col;
+  int erow, ecol;					// where the text ends (the position right after it)
+							// UNDO_REPLACE : (row, col) is the first match, erow / ecol the lengths of
+							// the two strings, text the matches then the strings, see Replace
+  int len, cap;						// bytes of text, and room there is for it (typed chars are added in place)
+  char text[];
+};
+
+
+struct undoChunk {					// a piece of the undo arena, records are laid one after the other
+  struct undoChunk *next;
+  size_t used, size;
+  char mem[];
+};
+
+
+struct undoLog {
+  struct undoChunk *head, *tail;			// oldest and newest chunk
+  size_t bytes;						// total size of the chunks
+  struct undoRec **recs;				// the records in order, recs[first .. cur) can be undone, recs[cur .. nrecs) redone
+  int first, cur, nrecs, cap;
+  int sealed;						// 1 when the next edit must not be merged with the last record
+  int ingroup;						// > 0 while records are added to the same user action
+  int replaying;					// 1 while undo/redo edit the text, so they are not recorded themselves
+};
+
+
+struct journalHead {					// start of a journal : the file its edits apply to
+  char magic[8];					// "MINOCHJ1"
+  uint64_t size, ino;
+  int64_t mtime, mtime_ns;
+};
+
+
+struct journalRec {					// an edit in the journal, followed by len bytes of text for an insert
+  uint32_t hash;					// FNV-1a of everything after it, a torn last record doesn't match
+  uint32_t len;
+  int32_t type;						// UNDO_INSERT, UNDO_DELETE or UNDO_REPLACE (same fields as its undo record)
+  int32_t row, col, erow, ecol;				// erow, ecol : end of a delete
+};
+
+
+struct journal {					// see Journal
+  char *path;						// NULL : edits are not journaled (no file name, replaying, other editor on it ...)
+  struct stat base;					// the file the edits apply to
+  int fd;						// -1 until the first batch is written
+  char *buf, *out;					// records waiting for the thread, records it is writing
+  size_t len, cap, outcap;
+  size_t last;						// where the last record starts in buf, typed chars are added to it (-1 : none)
+  int lrow, lcol;					// where the text of that record ends
+  uint32_t lhash;
+  unsigned gen;						// +1 when the journal starts over, a batch of an older gen is dropped
+  int started;
+  int error;						// errno of a failed write, shown once
+  pthread_t thread;
+  pthread_mutex_t lock;					// buf, len, gen
+  pthread_mutex_t iolock;				// fd, base and gen : held by the thread while it writes
+  pthread_cond_t wake;
+};
+
+
+struct inputRing {					// bytes read from the terminal but not turned into keys yet
+  char buf[MINOCH_INPUT_RING];
+  unsigned head, tail;					// read / write counters, they only grow (masked to index buf)
+};
+
+
+struct rowSlab {					// a block of memory the chars of many rows are cut from
+  struct rowSlab *next;
+  char mem[];
+};
+
+
+struct rowBig {						// the chars of a long row, malloc'ed alone
+  struct rowBig *prev, *next;
+  char mem[];
+};
+
+
+struct rowMem {						// see Row memory
+  struct rowSlab *slabs;
+  char *bump, *bumpend;					// the part of the last slab nothing was cut from yet
+  char *freelist[MINOCH_SLAB_CLASSES];			// freed blocks of each size, linked through their first bytes
+  struct rowBig *big;
+  size_t slabbytes, bigbytes;				// memory we got from malloc
+  size_t live, livebytes;				// blocks rows own right now, and their size : a row's ccap
+  unsigned long allocs;					// blocks handed out or grown since the start ...
+  unsigned long mallocs;				// ... and how many of them needed a malloc / realloc
+  int leaks;						// nb of times editorRowsClose found the accounting off
+};
+
+
+struct perfHist {					// log2 histogram : n[b] counts the values in [2^b, 2^(b+1))
+  unsigned long n[64];
+  unsigned long count;
+  unsigned long long last;
+};
+
+
+struct perfState {					// see Perf overlay
+  int show;						// Ctrl-P : the message bar shows the numbers instead of the status message
+  struct perfHist frame;				// time to build a frame (ns)
+  struct perfHist bytes;				// bytes sent for a frame
+  struct perfHist key;					// from the keys coming in to the end of the frame that shows them (ns)
+  unsigned long long key_t0;				// when the keys being handled came in, 0 : none
+  const char *log;					// --perf-log : where the histograms go at exit
+};
+
+
+struct benchState {					// headless runs, see Headless
+  int on;						// 1 : no terminal, keys come from script, the output is only counted
+  const char *name;
+  char *script;
+  size_t len, pos;
+  int rows, cols;					// the virtual screen
+  double *lat;						// time each key took, read + handle + redraw, in microseconds
+  int nlat, latcap;
+  size_t out;						// bytes the editor wrote to the terminal
+  unsigned long half_allocs;				// E.frame_allocs once half the script was played (-1 before)
+};
+
+
+struct followState {					// see Follow mode
+  int on;
+  int ifd;						// inotify : watches the file, and its directory for a new file with the same name
+  int fd;						// the file we have rows for, kept open so we can fstat it whatever happens to its name
+  char *name;						// its name in the directory
+  off_t size;						// bytes of it we have rows for
+  int missing;						// the name points to nothing right now (rotated away, not created again yet)
+  unsigned long long next;				// no update before that time (editorPerfNow), so appends are read in batches
+};
+
+
+struct wrapIndex {					// see Soft wrap
+  int on;
+  long *fw;						// Fenwick tree over the slots of E.row : screen lines each row takes (0 for the gap)
+  int n;						// nb of slots it was built for (E.rowcap)
+  int cols;						// screen width it was built for
+  int off;						// the screen starts at this line of row E.rowoff
+  int frame_rowoff, frame_off;				// where it started for the last frame, see editorFrameScroll
+  int cury, curx;					// where the cursor is on screen
+};
+
+
+struct frameLine {					// a screen line as we last sent it, see editorEmitLine
+  struct abuf line;
+  unsigned int hash;
+};
+
+
 
 
 struct editorConfig{
@@ -59,11 +404,55 @@ struct editorConfig{
 	int rowoff;								//row offset for vertical scrolling	
 	int coloff;								// columns offset for horizontal scrolling
 	int screenrows;									
-	int screencols;
+	int screencols;								// columns for the text : the terminal width minus the gutter
+	int termcols;
+	int linenums;								// line numbers on (Ctrl-N), they take the first E.gutter columns
+	int gutter;
 	int numrows;								//number of rows to be written
  	erow *row;								// editor row : a struct that holds text row ( the characters and the
+	int rowcap;								// nb of erow slots allocated in E.row (rows + gap)
+	int gap;								// index where the free slots (the gap) start, see Row storage
+	unsigned long long rowversion;						// last version handed to a row
+	struct renderSlot *rcache;						// renders of the rows we drew lately, see Render cache
+	int rcachelen;
+	int rlru_head, rlru_tail;
+	struct frameLine *frame;						// what the terminal shows right now, line by line (text rows + 2 bars)
+	int framelines;
+	int frame_valid;							// 0 when the terminal content is unknown : next refresh repaints everything
+	int frame_rowoff, frame_coloff;						// offsets the frame was drawn with, to detect scrolling
+	int frame_cx, frame_cy;
+	struct abuf ob;								// output of the current frame, see Append buffer
+	struct abuf lb;								// the screen line being built
+	unsigned long frame_allocs;						// nb of times the redraw path had to allocate memory
 	int dirty;								// variable to warn us if file's been changed or not	
 	char *filename;
+	char *map;								// the opened file, mmap'ed read only
+	size_t mapsize;
+	int mapfd;								// and kept open, save copies what was not edited from it
+	int match_row, match_col, match_len;					// current search match, highlighted on screen (match_len 0 = none)
+	struct searchState search;						// the background search, see Search
+	struct undoLog undo;							// see Undo
+	struct journal journal;
+	struct inputRing in;
+	erow *lrow;								// the long row that has a gap in its chars (NULL : none), see Long rows
+	int lgap, lgaplen;							// where the gap is and how long
+	struct editorSyntax *syntax;						// NULL : no highlighting
+	int hl_clean;								// rows before it have a known end state (hl_end), see editorSyntaxStartState
+	int hl_high;								// rows before it had one before the last edits ...
+	int hl_dirty_hi;							// ... except edited rows, the last of them is at most here
+	int sigfd;								// SIGWINCH (signalfd), see editorWaitInput
+	int timerfd;								// fires when the status message expires
+	int wakefd;								// eventfd, search workers poke it when they have new results
+	struct workerPool pool;
+	struct loadState load;
+	struct replaceState replace;
+	struct rowMem rowmem;
+	struct benchState bench;
+	struct perfState perf;
+	struct followState follow;
+	struct wrapIndex wrap;
+	pthread_rwlock_t rowlock;						// the main thread holds it for writing except while it waits for a key,
+										// search workers take it for reading : they only look at rows while nobody edits
 	char statusmsg[80];							//status msg (we'll use it for searching in the file) 
 	time_t statusmsg_time;							//we will erase the message after few seconds 
 
@@ -75,18 +464,88 @@ struct editorConfig E;
 
 
 
+/**** Filetypes ****/
+
+char *C_HL_extensions[] = { ".c", ".h", ".cpp", ".hpp", ".cc", ".cxx", ".hh", NULL };
+char *C_HL_keywords[] = {
+  "switch", "if", "while", "for", "break", "continue", "return", "else", "struct", "union", "typedef", "static", "enum",
+  "case", "default", "do", "goto", "sizeof", "const", "volatile", "extern", "inline", "register", "class", "namespace",
+  "template", "typename", "public", "private", "protected", "virtual", "new", "delete", "this", "using", "try", "catch",
+  "throw", "operator", "#include", "#define", "#undef", "#if", "#ifdef", "#ifndef", "#else", "#elif", "#endif", "#pragma",
+  "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|", "void|", "short|", "bool|", "auto|", "size_t|",
+  "true|", "false|", "NULL|", "nullptr|", NULL
+};
+
+char *JSON_HL_extensions[] = { ".json", NULL };
+char *JSON_HL_keywords[] = { "true|", "false|", "null|", NULL };
+
+char *LOG_HL_extensions[] = { ".log", "syslog", NULL };
+char *LOG_HL_keywords[] = { "ERROR", "FATAL", "CRITICAL", "PANIC", "WARN|", "WARNING|", NULL };
+
+struct editorSyntax HLDB[] = {
+  { "c", C_HL_extensions, C_HL_keywords, "//", "/*", "*/", HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS },
+  { "json", JSON_HL_extensions, JSON_HL_keywords, NULL, NULL, NULL, HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS },
+  { "log", LOG_HL_extensions, LOG_HL_keywords, NULL, NULL, NULL, HL_HIGHLIGHT_NUMBERS },
+};
+
+#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+
+
+
 /// Prototype : so we can use functions defined later in the file, wherever we want !
 
 void editorSetStatusMessage(const char *fmt, ...);
 void editorRefreshScreen();
-void *editorPrompt(char *prompt);
+void initEditor();
+char *editorPrompt(char *prompt, void (*callback)(char *, int));
+void editorSearchRowChanged(int at);
+void editorSearchRowInserted(int at);
+void editorSearchRowDeleted(int at);
+void editorSearchRowsAppended(int at, int n);
+void editorSearchStop();
+void editorFollowStop();
+int editorFollowWatch();
+void editorPoolStart(void (*job)(int));
+void editorPoolWait();
+void editorUndoInsert(int r, int c, const char *s, int len);
+void editorUndoDelete(int r, int c, int er, int ec, const char *s, int len);
+void editorUndoSeal();
+void editorJournalInsert(int r, int c, const char *s, int len);
+void editorJournalDelete(int r, int c, int er, int ec);
+void editorJournalReplace(const char *text, int len, int flen, int tlen);
+void editorJournalKick();
+void editorJournalOpen();
+void editorJournalReset();
+void editorJournalClose();
+void editorSyntaxRowChanged(int at);
+void editorSyntaxRowInserted(int at);
+void editorSyntaxRowsDeleted(int at, int n);
+void editorRowCloseGap();
+void editorReplaceUndo(struct undoRec *rec, int undo);
+int editorReplaceReplay(const char *text, int len, int flen, int tlen);
+void editorWrapSlotsMoved(int from, int count, int shift);
+void editorWrapRebuild();
+void editorWrapRowChanged(int at);
+void editorWrapRowsDeleted(int at, int n);
+struct renderSlot *editorRowRender(erow *row);
+int editorRenderCxToRx(struct renderSlot *rs, int cx);
+int editorRenderRxToCx(struct renderSlot *rs, int rx);
 
 
 /**** Terminal ****/
 
+void editorTermWrite(const char *s, size_t len){				// everything for the terminal goes through here
+	if(E.bench.on){								// headless : there is no terminal, we only count what it would get
+		E.bench.out += len;
+		return;
+	}
+	write(STDOUT_FILENO, s, len);
+}
+
+
 void die(const char *s){							// for error handling; C programms set the global  variable
-	write(STDOUT_FILENO, "\x1b[2J", 4);	
-	write(STDOUT_FILENO, "\x1b[H", 3);
+	editorTermWrite("\x1b[2J", 4);	
+	editorTermWrite("\x1b[H", 3);
 	
 	perror(s);								// errno to indicate the error; perror looks at the global errno and prints a discriptive error msg
 	exit(1);
@@ -95,6 +554,7 @@ void die(const char *s){							// for error handling; C programms set the global
 
 
 void disableRawMode(){										//function that disables raw mode; we will use it right before leaving the editor.
+	write(STDOUT_FILENO, "\x1b[?2004l", 8);							// bracketed paste off
 	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.original_termios) == -1 )			// set attributes of terminal back to original ones .. if we fail we throw error and die 
 	   die("tcsetattr");	
 }	
@@ -118,33 +578,158 @@ void enableRawMode(){  												//function that will enable raw mode !
 							// (IEXTEN; disable ctrl-v that will print next caractere literrarly (no escaping)) (ISIG;turn off ctrl-c and ctrl-z)
   	
   	raw.c_cc[VMIN] = 0;											//minimum number of input bytes needed before read() can return 
-        raw.c_cc[VTIME] = 1;           										// max time to wait before read() can return 100ms 
+        raw.c_cc[VTIME] = 0;           										// read() never waits : poll() does the waiting, see editorWaitInput
   	
   	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1 ) die("tcsetattr");
+  	write(STDOUT_FILENO, "\x1b[?2004h", 8);							// ask the terminal to mark pastes, see editorPaste
 	
 	}
 
 
+int editorSearchPoll();
+void editorResize();
+unsigned long long editorPerfNow();
+int editorFollowUpdate();
+int editorSyntaxBehind();
+int editorSyntaxIdle();
+
+/* the editor sleeps in poll() until something happens : a key, a window resize (SIGWINCH through a signalfd), the status
+ message timer, search progress (eventfd) or the followed file growing (inotify). nothing runs while idle, and a resize
+ redraws right away. the only exception : after a jump the highlighting catches up between keys, see editorSyntaxIdle. */
+
+int editorWaitInput(int ms){							// 1 when a key can be read, 0 after ms milliseconds (-1 = no limit)
+	struct pollfd fds[5] = {
+		{ E.bench.on ? -1 : STDIN_FILENO, POLLIN, 0 }, { E.sigfd, POLLIN, 0 }, { E.timerfd, POLLIN, 0 }, { E.wakefd, POLLIN, 0 },
+		{ -1, POLLIN, 0 }
+	};
+	int follow = E.follow.on && ms < 0;					// only while we wait for a key : E.rowlock is free then, see editorReadKey
+	int lex = ms < 0 && editorSyntaxBehind();				// same for the highlighting
+	if(E.bench.on) ms = 0;							// the script is always readable, only look at the rest
+	while(1){
+		int wait = ms;
+		fds[4].fd = -1;
+		if(follow){							// the file is looked at once per MINOCH_FOLLOW_MS at most
+			unsigned long long now = editorPerfNow();
+			if(now >= E.follow.next) fds[4].fd = E.follow.ifd;
+			else wait = (E.follow.next - now) / 1000000 + 1;
+		}
+		if(lex) wait = 0;						// only look, there is lexing to do if nothing came in
+		int n = poll(fds, 5, wait);
+		if(n == -1){
+			if(errno == EINTR) continue;
+			die("poll");
+		}
+		if(n == 0 && lex){
+			if(editorSyntaxIdle()) editorRefreshScreen();
+			lex = editorSyntaxBehind();
+			if(!E.bench.on) continue;				// (headless : one slice between two keys)
+		}
+		if(n == 0 && wait != ms) continue;				// only waited for the next follow update
+		if(n == 0) return E.bench.on;
+		int redraw = 0;
+		if(fds[1].revents & POLLIN){
+			struct signalfd_siginfo si;
+			while(read(E.sigfd, &si, sizeof(si)) == sizeof(si));
+			editorResize();
+			redraw = 1;
+		}
+		if(fds[2].revents & POLLIN){				// the status message is too old now, it has to go
+			uint64_t ticks;
+			read(E.timerfd, &ticks, sizeof(ticks));
+			redraw = 1;
+		}
+		if(fds[3].revents & POLLIN){
+			uint64_t pokes;
+			read(E.wakefd, &pokes, sizeof(pokes));
+			redraw |= editorSearchPoll();			// new search results : show the count, maybe jump to the match
+		}
+		if(fds[4].revents & POLLIN)
+			redraw |= editorFollowUpdate();
+		if(redraw) editorRefreshScreen();
+		if(fds[0].revents || E.bench.on) return 1;
+	}
+}
+
+/* keys come out of a ring buffer : we read everything the terminal has for us (a paste can be megabytes) in one syscall,
+ and main() only redraws once every key already in there has been handled. */
+
+int editorInputFill(){								// read what is available into the ring, without waiting
+	struct inputRing *in = &E.in;
+	unsigned count = in->tail - in->head;
+	if(count == MINOCH_INPUT_RING) return 0;
+	unsigned off = in->tail & (MINOCH_INPUT_RING - 1);
+	unsigned h = in->head & (MINOCH_INPUT_RING - 1);
+	unsigned room = off < h ? h - off : MINOCH_INPUT_RING - off;		// contiguous free space after off
+	if(E.bench.on){								// headless : the next bytes of the script
+		size_t left = E.bench.len - E.bench.pos;
+		if(room > left) room = left;
+		memcpy(&in->buf[off], E.bench.script + E.bench.pos, room);
+		E.bench.pos += room;
+		in->tail += room;
+		if(room > 0 && E.perf.key_t0 == 0) E.perf.key_t0 = editorPerfNow();
+		return room;
+	}
+	int nread = read(STDIN_FILENO, &in->buf[off], room);
+	if(nread == -1 && errno != EAGAIN) die("read");
+	if(nread > 0) in->tail += nread;
+	if(nread > 0 && E.perf.key_t0 == 0) E.perf.key_t0 = editorPerfNow();	// the clock for key to paint starts here
+	return nread;
+}
+
+
+int editorInputByte(char *c){							// next byte, 0 if none came in MINOCH_ESC_TIMEOUT_MS
+	struct inputRing *in = &E.in;
+	if(in->head == in->tail && (!editorWaitInput(MINOCH_ESC_TIMEOUT_MS) || editorInputFill() <= 0)) return 0;
+	*c = in->buf[in->head++ & (MINOCH_INPUT_RING - 1)];
+	return 1;
+}
+
+
+int editorInputPending(){							// is there a key we can read without waiting ?
+	int n = 0;
+	if(E.in.head != E.in.tail) return 1;
+	if(E.bench.on) return E.bench.pos < E.bench.len;
+	return ioctl(STDIN_FILENO, FIONREAD, &n) == 0 && n > 0;
+}
+
+
 int editorReadKey(){										// function to read the keypresses
-	int nread;
-	char c;
-	while((nread = read(STDIN_FILENO, &c, 1)) != 1){
-		if(nread == -1 && errno != EAGAIN) die ("read");
+	char c = 0;
+	if(E.in.head == E.in.tail){
+		if(E.search.query) editorRowCloseGap();				// the search workers read rows in one piece
+		pthread_rwlock_unlock(&E.rowlock);					// while we wait for the user the search workers may read the rows
+		while(1){
+			editorWaitInput(-1);
+			int nread = editorInputFill();
+			if(nread > 0) break;
+			if(nread == 0) exit(E.bench.on ? 0 : 1);			// readable but nothing to read : the terminal is gone (or the script is over)
+		}
+		pthread_rwlock_wrlock(&E.rowlock);
 	}
+	editorInputByte(&c);
 	
-	if(c == '\x1b'){ 							// when the user enters an escape, we immediately read 2 more bytes into seq buffer, if reads time out we assume user just pressed escape key and return that. otherwise we look which arrow key sequence was and return it.
-		char seq[3];
-		if(read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-		if(read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+	if(c == '\x1b'){ 							// when the user enters an escape, we read 2 more bytes into seq buffer, if reads time out we assume user just pressed escape key and return that. otherwise we look which arrow key sequence was and return it.
+		char seq[3] = {0, 0, 0};
+		if(!editorInputByte(&seq[0])) return '\x1b';
+		if(!editorInputByte(&seq[1])) return '\x1b';
 
 	    if(seq[0] == '['){
 			if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
+        int n = seq[1] - '0';							// ESC[<number>~ , the number can be 3 digits (200 / 201 for pastes)
+        while(editorInputByte(&seq[2]) && seq[2] >= '0' && seq[2] <= '9') n = n * 10 + seq[2] - '0';
         if (seq[2] == '~') {
-          switch (seq[1]) {
-            case '5': return PAGE_UP;
-            case '6': return PAGE_DOWN;
+          switch (n) {
+            case 5: return PAGE_UP;
+            case 6: return PAGE_DOWN;
+            case 200: return PASTE_START;
+            case 201: return PASTE_END;
           }
+        } else if (seq[2] == ';') {					// ESC[1;<modifier>H / F : Home / End with Ctrl held (modifier 5)
+          int mod = 0;
+          char k = 0;
+          while(editorInputByte(&k) && k >= '0' && k <= '9') mod = mod * 10 + k - '0';
+          if (n == 1 && mod == 5 && k == 'H') return FILE_START;
+          if (n == 1 && mod == 5 && k == 'F') return FILE_END;
         }
       } else {			
 			switch (seq[1]) {
@@ -158,7 +743,7 @@ int editorReadKey(){										// function to read the keypresses
 	}
 		return '\x1b';
 	}else { 
-		return c;
+		return (unsigned char)c;					// bytes of non ASCII chars are 128-255, never negative
 	}
 }
 
@@ -169,6 +754,11 @@ int editorReadKey(){										// function to read the keypresses
 
 int getWindowSize(int *rows, int *cols){
 	struct winsize ws;
+	if(E.bench.on){								// headless : the size we were told
+		*rows = E.bench.rows;
+		*cols = E.bench.cols;
+		return 0;
+	}
 	
 	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col ==0){
 	  return -1;
@@ -180,283 +770,3777 @@ int getWindowSize(int *rows, int *cols){
 
 }
 
-/**** Row operations ****/
+/**** Row memory ****/
 
-int editorRowCxToRx(erow *row, int cx) {
-  int rx = 0;
-  int j;
-  for (j = 0; j < cx; j++) {
-    if (row->chars[j] == '\t')
-      rx += (MINOCH_TAB_STOP - 1) - (rx % MINOCH_TAB_STOP);
-    rx++;
-  }
-  return rx;
-}
-
-
-void editorUpdateRow(erow *row) {
-  int tabs = 0;
-  int j;
-  for (j = 0; j < row->size; j++)
-    if (row->chars[j] == '\t') tabs++;
-  free(row->render);
-  row->render = malloc(row->size + tabs*(MINOCH_TAB_STOP - 1) + 1);
-  int idx = 0;
-  for (j = 0; j < row->size; j++) {
-    if (row->chars[j] == '\t') {
-      row->render[idx++] = ' ';
-      while (idx % MINOCH_TAB_STOP != 0) row->render[idx++] = ' ';
-    } else {
-      row->render[idx++] = row->chars[j];
-    }
-  }
-  row->render[idx] = '\0';
-  row->rsize = idx;
+/* the chars of the rows come from size classes (16, 24, 32, 48 ... 16384 bytes, steps of 1.5x then 4/3x) cut from 256 KB slabs,
+ and the rest of the class is room to grow : typing in a row only moves it to a bigger block when it crosses a class. freed
+ blocks go on the free list of their class and are handed out again first; longer rows get their own malloc with 50% more
+ room. nothing is given back while the file is open, it all goes at once in editorRowsClose. E.rowmem.live / livebytes
+ always equal the blocks the rows own and the sum of their ccap, editorRowsClose checks it. */
+
+static const int rowClassSize[MINOCH_SLAB_CLASSES] = {
+	16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384
+};
+
+
+int editorCharsClass(int size){						// smallest class of at least size bytes
+	int k = 0;
+	while(rowClassSize[k] < size) k++;
+	return k;
 }
 
 
+void editorCharsNewSlab(){
+	struct rowMem *M = &E.rowmem;
+	while(M->bumpend - M->bump >= rowClassSize[0]){			// what is left of the old slab goes to the free lists
+		int k = MINOCH_SLAB_CLASSES - 1;
+		while(rowClassSize[k] > M->bumpend - M->bump) k--;
+		*(char **)M->bump = M->freelist[k];
+		M->freelist[k] = M->bump;
+		M->bump += rowClassSize[k];
+	}
+	struct rowSlab *s = malloc(sizeof(struct rowSlab) + MINOCH_SLAB_SIZE);
+	if(s == NULL) die("malloc");
+	s->next = M->slabs;
+	M->slabs = s;
+	M->bump = s->mem;
+	M->bumpend = s->mem + MINOCH_SLAB_SIZE;
+	M->slabbytes += sizeof(struct rowSlab) + MINOCH_SLAB_SIZE;
+	M->mallocs++;
+}
 
-void editorInsertRow(int at, char *s, size_t len) {
 
-  if (at < 0 || at > E.numrows) return;				//validate the index 
+char *editorCharsAlloc(int size, int *cap){				// a block of at least size bytes, its real size goes in *cap
+	struct rowMem *M = &E.rowmem;
+	char *p;
+	M->allocs++;
+	M->live++;
+	if(size > MINOCH_SLAB_MAX){
+		size_t c = (size_t)size + size / 2;
+		if(c > INT_MAX) c = INT_MAX;
+		struct rowBig *b = malloc(sizeof(struct rowBig) + c);
+		if(b == NULL) die("malloc");
+		b->prev = NULL;
+		b->next = M->big;
+		if(M->big) M->big->prev = b;
+		M->big = b;
+		M->bigbytes += c;
+		M->mallocs++;
+		M->livebytes += c;
+		*cap = c;
+		return b->mem;
+	}
+	int k = editorCharsClass(size);
+	if(M->freelist[k]){
+		p = M->freelist[k];
+		M->freelist[k] = *(char **)p;
+	}else{
+		if(M->bumpend - M->bump < rowClassSize[k]) editorCharsNewSlab();
+		p = M->bump;
+		M->bump += rowClassSize[k];
+	}
+	M->livebytes += rowClassSize[k];
+	*cap = rowClassSize[k];
+	return p;
+}
 
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));	//allocate memo for one more erow
-  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at));
 
-  E.row[at].size = len;
-  E.row[at].chars = malloc(len + 1);
-  memcpy(E.row[at].chars, s, len);
-  E.row[at].chars[len] = '\0';
+void editorCharsFree(char *p, int cap){
+	struct rowMem *M = &E.rowmem;
+	if(p == NULL) return;
+	M->live--;
+	M->livebytes -= cap;
+	if(cap > MINOCH_SLAB_MAX){
+		struct rowBig *b = (struct rowBig *)(p - offsetof(struct rowBig, mem));
+		if(b->prev) b->prev->next = b->next;
+		else M->big = b->next;
+		if(b->next) b->next->prev = b->prev;
+		M->bigbytes -= cap;
+		free(b);
+		return;
+	}
+	int k = editorCharsClass(cap);
+	*(char **)p = M->freelist[k];
+	M->freelist[k] = p;
+}
 
-  E.row[at].rsize = 0;
-  E.row[at].render = NULL;
-  editorUpdateRow(&E.row[at]);
 
-  E.numrows++;
-  E.dirty++;
+char *editorCharsGrow(char *p, int *cap, int used, int size){		// make a block of *cap bytes (used of them matter) hold size
+	struct rowMem *M = &E.rowmem;
+	if(size <= *cap) return p;
+	if(*cap > MINOCH_SLAB_MAX){					// already alone : realloc it, there may be room after it
+		struct rowBig *b = (struct rowBig *)(p - offsetof(struct rowBig, mem));
+		size_t c = (size_t)size + size / 2;
+		if(c > INT_MAX) c = INT_MAX;
+		b = realloc(b, sizeof(struct rowBig) + c);
+		if(b == NULL) die("realloc");
+		if(b->prev) b->prev->next = b;
+		else M->big = b;
+		if(b->next) b->next->prev = b;
+		M->bigbytes += c - *cap;
+		M->livebytes += c - *cap;
+		M->allocs++;
+		M->mallocs++;
+		*cap = c;
+		return b->mem;
+	}
+	int newcap;
+	char *q = editorCharsAlloc(size, &newcap);
+	memcpy(q, p, used);
+	editorCharsFree(p, *cap);
+	*cap = newcap;
+	return q;
 }
 
 
-void editorFreeRow(erow *row) {
-  free(row->chars);
+void editorCharsReleaseAll(){						// give every block back at once, the rows must not use them anymore
+	struct rowMem *M = &E.rowmem;
+	while(M->slabs){
+		struct rowSlab *s = M->slabs;
+		M->slabs = s->next;
+		free(s);
+	}
+	while(M->big){
+		struct rowBig *b = M->big;
+		M->big = b->next;
+		free(b);
+	}
+	memset(M->freelist, 0, sizeof(M->freelist));
+	M->bump = M->bumpend = NULL;
+	M->slabbytes = M->bigbytes = 0;
+	M->live = M->livebytes = 0;
 }
 
 
-void editorDelRow(int at) {
-  if (at < 0 || at >= E.numrows) return;
-  editorFreeRow(&E.row[at]);
-  memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-  E.numrows--;
-  E.dirty++;
+
+/**** Row storage ****/
+
+// the rows live in a gap buffer : E.row has E.rowcap slots, the E.rowcap - E.numrows unused ones are kept together starting at E.gap.
+// inserting or deleting a row moves the gap to that spot first, so edits near the cursor only shift the few rows between the gap
+// and the cursor instead of memmoving every row until the end of the file. Always go through editorRowAt() to get a row !
+
+erow *editorRowAt(int at){
+	return &E.row[at < E.gap ? at : at + (E.rowcap - E.numrows)];
 }
 
 
+int editorRowIndex(erow *row){						// the other way around : index of a row we have a pointer to
+	int i = row - E.row;
+	return i < E.gap ? i : i - (E.rowcap - E.numrows);
+}
 
 
+void editorRowMoveGap(int at){						// slide the gap so it starts at row "at"
+	editorRowCloseGap();							// the rows are about to move, E.lrow would point to another one
+	int gaplen = E.rowcap - E.numrows, old = E.gap;
+	if(at < E.gap)
+		memmove(&E.row[at + gaplen], &E.row[at], sizeof(erow) * (E.gap - at));
+	else if(at > E.gap)
+		memmove(&E.row[E.gap], &E.row[E.gap + gaplen], sizeof(erow) * (at - E.gap));
+	E.gap = at;
+	if(at < old) editorWrapSlotsMoved(at, old - at, gaplen);		// their heights move with them
+	else if(at > old) editorWrapSlotsMoved(old + gaplen, at - old, -gaplen);
+}
 
-void editorRowInsertChar(erow *row, int at, int c){			//"at" is the index we will insert the char at,
-	if(at < 0 || at > row->size) at = row->size;			
-	row->chars = realloc(row->chars, row->size +2);			// zow->size+2; the +2 : 1 byte for the char we will insert the second foe the null byte
-	memmove(&row->chars[at+1], &row->chars[at], row->size-at +1);
-	row->size++;
-	row->chars[at] = c;
-	editorUpdateRow(row);
-	E.dirty++;
 
+void editorRowReserve(int n){						// make sure the gap can take n more rows, growing geometrically
+	editorRowCloseGap();
+	if(E.numrows + n <= E.rowcap) return;
+	int newcap = E.rowcap ? E.rowcap : 64;
+	while(newcap < E.numrows + n) newcap *= 2;
+	int tail = E.numrows - E.gap;					// rows sitting after the gap have to stay at the end of the array
+	E.row = realloc(E.row, sizeof(erow) * newcap);
+	if(E.row == NULL) die("realloc");
+	memmove(&E.row[newcap - tail], &E.row[E.rowcap - tail], sizeof(erow) * tail);
+	E.rowcap = newcap;
+	editorWrapRebuild();							// every row after the gap changed slot
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len) {	// this function s gonna be used when we delete something from begining of a line, so the content of that line is going up to line above !
-  row->chars = realloc(row->chars, row->size + len + 1);		//  we allocate memo for row->size + len + 1 for the null byte
-  memcpy(&row->chars[row->size], s, len);			// we then move the content to the end of above line 
-  row->size += len;						// update new size
-  row->chars[row->size] = '\0';					// add null byte
-  editorUpdateRow(row);						// update the row 
-  E.dirty++;							// dirty bit updated ! 
+
+
+char *editorRowData(erow *row){						// the text of a row, wherever it is; not null terminated when it comes from the map !
+	if(row == E.lrow) editorRowCloseGap();
+	return row->chars ? row->chars : E.map + row->foff;
 }
 
 
+void editorRowMaterialize(erow *row){					// copy a mapped row to the heap so it can be edited 
+	if(row == E.lrow) editorRowCloseGap();				// the edit functions expect the text in one piece
+	if(row->chars) return;
+	row->chars = editorCharsAlloc(row->size + 1, &row->ccap);
+	memcpy(row->chars, E.map + row->foff, row->size);
+	row->chars[row->size] = '\0';
+}
 
 
-void editorRowDelChar(erow *row, int at){				//function to delete a character argument at is the index !
-	if(at < 0 || at >= row->size) return;
-	memmove(&row->chars[at], &row->chars[at+1], row->size -at);
-	row->size--;
-	editorUpdateRow(row);
-	E.dirty++;
+/* long rows (minified json, dumps ...) : a row longer than MINOCH_LONG_ROW gets a gap in its chars where we type, like the
+ rows array, so a key moves a few bytes instead of a 50 MB line. only one row has a gap at a time (E.lrow), it is closed
+ before anything needs the text in one piece (editorRowData, the other edit functions) or before the rows move. */
+
+void editorRowCloseGap(){
+	erow *row = E.lrow;
+	if(row == NULL) return;
+	E.lrow = NULL;
+	memmove(&row->chars[E.lgap], &row->chars[E.lgap + E.lgaplen], row->size - E.lgap + 1);
 }
 
 
+char editorRowCharAt(erow *row, int at){				// one char of a row, without closing its gap
+	if(row == E.lrow) return row->chars[at < E.lgap ? at : at + E.lgaplen];
+	return editorRowData(row)[at];
+}
 
 
-/**** Editor Operations ****/
+void editorRowOpenGap(erow *row, int at, int need){			// put the gap of a long row at "at", with room for need chars
+	if(E.lrow != row){
+		editorRowCloseGap();
+		editorRowMaterialize(row);
+		E.lrow = row;
+		E.lgap = row->size;					// an empty gap at the end to start with
+		E.lgaplen = 0;
+	}
+	if(E.lgaplen < need){
+		char *chars = editorCharsGrow(row->chars, &row->ccap, row->size + E.lgaplen + 1, row->size + E.lgaplen + MINOCH_LONG_GAP + 1);
+		memmove(&chars[E.lgap + E.lgaplen + MINOCH_LONG_GAP], &chars[E.lgap + E.lgaplen], row->size - E.lgap + 1);
+		row->chars = chars;
+		E.lgaplen += MINOCH_LONG_GAP;
+	}
+	if(at < E.lgap) memmove(&row->chars[at + E.lgaplen], &row->chars[at], E.lgap - at);
+	else if(at > E.lgap) memmove(&row->chars[E.lgap], &row->chars[E.lgap + E.lgaplen], at - E.lgap);
+	E.lgap = at;
+}
 
 
-void editorInsertChar(int c){
-	if(E.cy == E.numrows){				// if we'r at the end of the file 
-		editorInsertRow(E.numrows, "", 0);		// then we append a new row before inserting in it
+void editorAppendMappedRow(off_t foff, int len){			// add a row that still lives in E.map, nothing is copied or rendered
+	editorRowReserve(1);
+	editorRowMoveGap(E.numrows);
+	erow *row = &E.row[E.numrows];
+	row->size = len;
+	row->rslot = -1;
+	row->chars = NULL;
+	row->foff = foff;
+	row->version = ++E.rowversion;
+	row->hl_ok = 0;
+	E.gap++;
+	E.numrows++;
+	editorWrapRowChanged(E.numrows - 1);
+}
+
+
+
+/**** UTF-8 ****/
+
+/* chars are UTF-8 : a row column is not a byte anymore. the render keeps the bytes of every char (tabs as spaces, invalid
+ bytes as '?') and the tab index of the render slot gets a stop for every non ASCII char too, so columns, chars and render
+ bytes still convert with a binary search. finding those chars is done 16 or 32 bytes at a time : a row of plain ASCII
+ with no tabs is one scan and one memcpy, like before. widths come from a table of ranges : 2 columns for wide chars (CJK,
+ emoji), 0 for combining marks, which stay with the char before them (the cursor never stops between them). */
+
+struct widthRange {
+  unsigned lo, hi;
+  int width;
+};
+
+static const struct widthRange widthTable[] = {			// sorted, everything not in here is 1 column wide
+	{ 0x0300, 0x036F, 0 }, { 0x0483, 0x0489, 0 }, { 0x0591, 0x05BD, 0 }, { 0x05BF, 0x05BF, 0 }, { 0x05C1, 0x05C2, 0 },
+	{ 0x05C4, 0x05C5, 0 }, { 0x05C7, 0x05C7, 0 }, { 0x0610, 0x061A, 0 }, { 0x064B, 0x065F, 0 }, { 0x0670, 0x0670, 0 },
+	{ 0x06D6, 0x06DC, 0 }, { 0x06DF, 0x06E4, 0 }, { 0x06E7, 0x06E8, 0 }, { 0x06EA, 0x06ED, 0 }, { 0x0711, 0x0711, 0 },
+	{ 0x0730, 0x074A, 0 }, { 0x07A6, 0x07B0, 0 }, { 0x0900, 0x0902, 0 }, { 0x093A, 0x093A, 0 }, { 0x093C, 0x093C, 0 },
+	{ 0x0941, 0x0948, 0 }, { 0x094D, 0x094D, 0 }, { 0x0951, 0x0957, 0 }, { 0x0E31, 0x0E31, 0 }, { 0x0E34, 0x0E3A, 0 },
+	{ 0x0E47, 0x0E4E, 0 }, { 0x1100, 0x115F, 2 }, { 0x1AB0, 0x1AFF, 0 }, { 0x1DC0, 0x1DFF, 0 }, { 0x200B, 0x200F, 0 },
+	{ 0x202A, 0x202E, 0 }, { 0x2060, 0x2064, 0 }, { 0x20D0, 0x20FF, 0 }, { 0x231A, 0x231B, 2 }, { 0x2329, 0x232A, 2 },
+	{ 0x23E9, 0x23EC, 2 }, { 0x23F0, 0x23F0, 2 }, { 0x23F3, 0x23F3, 2 }, { 0x25FD, 0x25FE, 2 }, { 0x2614, 0x2615, 2 },
+	{ 0x2648, 0x2653, 2 }, { 0x267F, 0x267F, 2 }, { 0x2693, 0x2693, 2 }, { 0x26A1, 0x26A1, 2 }, { 0x26AA, 0x26AB, 2 },
+	{ 0x26BD, 0x26BE, 2 }, { 0x26C4, 0x26C5, 2 }, { 0x26CE, 0x26CE, 2 }, { 0x26D4, 0x26D4, 2 }, { 0x26EA, 0x26EA, 2 },
+	{ 0x26F2, 0x26F3, 2 }, { 0x26F5, 0x26F5, 2 }, { 0x26FA, 0x26FA, 2 }, { 0x26FD, 0x26FD, 2 }, { 0x2705, 0x2705, 2 },
+	{ 0x270A, 0x270B, 2 }, { 0x2728, 0x2728, 2 }, { 0x274C, 0x274C, 2 }, { 0x274E, 0x274E, 2 }, { 0x2753, 0x2755, 2 },
+	{ 0x2757, 0x2757, 2 }, { 0x2795, 0x2797, 2 }, { 0x27B0, 0x27B0, 2 }, { 0x27BF, 0x27BF, 2 }, { 0x2B1B, 0x2B1C, 2 },
+	{ 0x2B50, 0x2B50, 2 }, { 0x2B55, 0x2B55, 2 }, { 0x2E80, 0x303E, 2 }, { 0x3041, 0x33FF, 2 }, { 0x3400, 0x4DBF, 2 },
+	{ 0x4E00, 0x9FFF, 2 }, { 0xA000, 0xA4CF, 2 }, { 0xA960, 0xA97F, 2 }, { 0xAC00, 0xD7A3, 2 }, { 0xF900, 0xFAFF, 2 },
+	{ 0xFE00, 0xFE0F, 0 }, { 0xFE10, 0xFE19, 2 }, { 0xFE20, 0xFE2F, 0 }, { 0xFE30, 0xFE6F, 2 }, { 0xFEFF, 0xFEFF, 0 },
+	{ 0xFF00, 0xFF60, 2 }, { 0xFFE0, 0xFFE6, 2 }, { 0x1F004, 0x1F004, 2 }, { 0x1F0CF, 0x1F0CF, 2 }, { 0x1F18E, 0x1F18E, 2 },
+	{ 0x1F191, 0x1F19A, 2 }, { 0x1F200, 0x1F2FF, 2 }, { 0x1F300, 0x1F3FA, 2 }, { 0x1F3FB, 0x1F3FF, 0 }, { 0x1F400, 0x1F64F, 2 },
+	{ 0x1F680, 0x1F6FF, 2 }, { 0x1F900, 0x1F9FF, 2 }, { 0x1FA70, 0x1FAFF, 2 }, { 0x20000, 0x2FFFD, 2 }, { 0x30000, 0x3FFFD, 2 },
+	{ 0xE0100, 0xE01EF, 0 }
+};
+
+
+int editorCharWidth(int cp){						// columns of a code point, -1 (invalid byte) shows as one '?'
+	if(cp < 0x300) return 1;
+	int lo = 0, hi = sizeof(widthTable) / sizeof(widthTable[0]);
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(widthTable[mid].hi < (unsigned)cp) lo = mid + 1;
+		else hi = mid;
 	}
-	editorRowInsertChar(&E.row[E.cy], E.cx, c);
-	E.cx++;
+	return lo < (int)(sizeof(widthTable) / sizeof(widthTable[0])) && widthTable[lo].lo <= (unsigned)cp ? widthTable[lo].width : 1;
+}
+
+
+int editorUtf8Decode(const char *s, int n, int *cp){			// bytes of the char at s; an invalid byte is a char of its own, cp -1
+	const unsigned char *u = (const unsigned char *)s;
+	int len, c, j;
+	if(u[0] < 0x80){
+		*cp = u[0];
+		return 1;
+	}
+	if(u[0] >= 0xC2 && u[0] <= 0xDF){ len = 2; c = u[0] & 0x1F; }
+	else if(u[0] >= 0xE0 && u[0] <= 0xEF){ len = 3; c = u[0] & 0x0F; }
+	else if(u[0] >= 0xF0 && u[0] <= 0xF4){ len = 4; c = u[0] & 0x07; }
+	else { *cp = -1; return 1; }
+	if(len > n){ *cp = -1; return 1; }
+	for(j = 1; j < len; j++){
+		if((u[j] & 0xC0) != 0x80){ *cp = -1; return 1; }
+		c = (c << 6) | (u[j] & 0x3F);
+	}
+	if((len == 3 && (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))) || (len == 4 && (c < 0x10000 || c > 0x10FFFF))){
+		*cp = -1;						// overlong, surrogate or out of range
+		return 1;
+	}
+	*cp = c;
+	return len;
+}
+
+
+int editorScanSpecialScalar(const char *s, int n){			// index of the first tab or non ASCII byte, n if none
+	int j;
+	for(j = 0; j < n; j++)
+		if(s[j] == '\t' || (unsigned char)s[j] >= 0x80) return j;
+	return n;
+}
+
+
+#if defined(__SSE2__)
+int editorScanSpecialSSE2(const char *s, int n){
+	__m128i tab = _mm_set1_epi8('\t');
+	int j = 0;
+	for(; j + 16 <= n; j += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + j));
+		int m = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, tab));	// high bit set, or a tab
+		if(m) return j + __builtin_ctz(m);
+	}
+	return j + editorScanSpecialScalar(s + j, n - j);
+}
+#endif
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int editorScanSpecialAVX2(const char *s, int n){
+	__m256i tab = _mm256_set1_epi8('\t');
+	int j = 0;
+	for(; j + 32 <= n; j += 32){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + j));
+		unsigned m = _mm256_movemask_epi8(v) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, tab));
+		if(m) return j + __builtin_ctz(m);
+	}
+	return j + editorScanSpecialScalar(s + j, n - j);
+}
+#endif
+
+
+int editorScanSpecial(const char *s, int n){
+	if(n < 16) return editorScanSpecialScalar(s, n);		// short rows : not worth the setup
+#if defined(__x86_64__) || defined(__i386__)
+	static int avx2 = -1;
+	if(avx2 == -1) avx2 = __builtin_cpu_supports("avx2");
+	if(avx2) return editorScanSpecialAVX2(s, n);
+#endif
+#if defined(__SSE2__)
+	return editorScanSpecialSSE2(s, n);
+#else
+	return editorScanSpecialScalar(s, n);
+#endif
+}
+
+
+int editorRowDecodeAt(erow *row, int at, int *cp){			// editorUtf8Decode on a row, without closing a long row's gap
+	char buf[4];
+	int n = row->size - at < 4 ? row->size - at : 4, j;
+	for(j = 0; j < n; j++) buf[j] = editorRowCharAt(row, at + j);
+	return editorUtf8Decode(buf, n, cp);
+}
+
+
+int editorRowNextChar(erow *row, int cx){				// where the char after the one at cx starts, combining marks included
+	int cp;
+	if(cx >= row->size) return row->size;
+	cx += editorRowDecodeAt(row, cx, &cp);
+	while(cx < row->size && (unsigned char)editorRowCharAt(row, cx) >= 0x80){
+		int len = editorRowDecodeAt(row, cx, &cp);
+		if(cp < 0 || editorCharWidth(cp) != 0) break;
+		cx += len;
+	}
+	return cx;
+}
+
+
+int editorRowPrevChar(erow *row, int cx){				// where the char before cx starts (the base char of its marks)
+	int cp;
+	while(cx > 0){
+		int start = cx - 1, j;
+		for(j = 0; j < 3 && start > 0 && ((unsigned char)editorRowCharAt(row, start) & 0xC0) == 0x80; j++) start--;
+		if(start + editorRowDecodeAt(row, start, &cp) != cx){	// cx - 1 was not the end of a valid char
+			cp = -1;
+			start = cx - 1;
+		}
+		cx = start;
+		if(cp < 0 || editorCharWidth(cp) != 0) break;		// a combining mark : keep going back to its base
+	}
+	return cx;
+}
+
+
+
+/**** Row operations ****/
+
+int editorRowCxToRx(erow *row, int cx) {			// render column of char cx, O(log tabs) with the tab index of the row render
+  return editorRenderCxToRx(editorRowRender(row), cx);
+}
+
+
+int editorRowRxToCx(erow *row, int rx) {			// and the other way around, a column inside a tab gives that tab
+  int cx = editorRenderRxToCx(editorRowRender(row), rx);
+  return cx > row->size ? row->size : cx;
+}
+
+
+void editorUpdateRow(erow *row) {				// the row changed : new version, its cached render (if any) is now stale
+  row->version = ++E.rowversion;
+  row->hl_ok = 0;
+  editorWrapRowChanged(editorRowIndex(row));		// it may take another nb of lines when wrapped
+  editorSearchRowChanged(editorRowIndex(row));		// and its search matches are too
+  editorSyntaxRowChanged(editorRowIndex(row));		// and maybe the highlight of the rows after it
+}
+
+
+
+/**** Render cache ****/
+
+// renders are built only for the rows we draw and kept in a fixed number of slots, the least recently drawn slot gets reused.
+// a slot belongs to a row as long as their versions match, so editing a row (new version) or deleting it needs no cleanup here.
+// memory for renders depends on the screen size, not on the file size.
+
+void editorRenderCacheResize(int n){
+	int j;
+	for(j = 0; j < E.rcachelen; j++){
+		free(E.rcache[j].render);
+		free(E.rcache[j].hl);
+		free(E.rcache[j].tabs);
+	}
+	free(E.rcache);
+	E.rcache = calloc(n, sizeof(struct renderSlot));
+	if(E.rcache == NULL) die("calloc");
+	for(j = 0; j < n; j++){					// all slots start free, chained in order
+		E.rcache[j].prev = j - 1;
+		E.rcache[j].next = j + 1 < n ? j + 1 : -1;
+	}
+	E.rcachelen = n;
+	E.rlru_head = 0;
+	E.rlru_tail = n - 1;
+}
+
+
+void editorRenderCacheTouch(int slot){				// move a slot to the front of the LRU list
+	struct renderSlot *rs = &E.rcache[slot];
+	if(E.rlru_head == slot) return;
+	E.rcache[rs->prev].next = rs->next;			// unlink, prev exists since we are not the head
+	if(rs->next != -1) E.rcache[rs->next].prev = rs->prev;
+	else E.rlru_tail = rs->prev;
+	rs->prev = -1;
+	rs->next = E.rlru_head;
+	E.rcache[E.rlru_head].prev = slot;
+	E.rlru_head = slot;
+}
+
+
+struct renderSlot *editorRowCachedRender(erow *row){		// the render of a row if it is in the cache and up to date, else NULL
+	if(row->rslot >= 0 && row->rslot < E.rcachelen && E.rcache[row->rslot].version == row->version)
+		return &E.rcache[row->rslot];
+	return NULL;
+}
+
+
+void editorRenderReserve(struct renderSlot *rs, int need){
+	if(need <= rs->cap) return;
+	int cap = rs->cap ? rs->cap : 64;
+	while(cap < need) cap *= 2;
+	char *new = realloc(rs->render, cap);
+	if(new == NULL) die("realloc");
+	rs->render = new;
+	rs->cap = cap;
+}
+
+
+void editorRenderWindow(erow *row, struct renderSlot *rs){	// render the part of a long row around the screen
+	int w0 = E.coloff - E.coloff % 256;				// a bit more than the screen, so scrolling sideways doesn't redo it each time
+	int w = E.screencols + 512;
+	int cx = editorRenderRxToCx(rs, w0);				// the char on column w0, maybe a tab (or wide char) that started before it
+	if(cx > row->size) cx = row->size;
+	int col = editorRenderCxToRx(rs, cx);
+	int idx = 0;
+	while(cx < row->size && col < w0 + w){
+		editorRenderReserve(rs, idx + MINOCH_TAB_STOP + 5);
+		char c = editorRowCharAt(row, cx);
+		if(c == '\t'){
+			int rend = (col / MINOCH_TAB_STOP + 1) * MINOCH_TAB_STOP;
+			for(; col < rend; col++) if(col >= w0) rs->render[idx++] = ' ';
+			cx++;
+			continue;
+		}
+		int cp, len = (unsigned char)c < 0x80 ? 1 : editorRowDecodeAt(row, cx, &cp);
+		int cw = len == 1 && (unsigned char)c < 0x80 ? 1 : editorCharWidth(cp);
+		if(col < w0){							// a wide char cut by the left edge of the window : spaces for what shows
+			int vis = col + cw - w0;
+			while(vis-- > 0) rs->render[idx++] = ' ';
+		}else if((unsigned char)c < 0x80){
+			rs->render[idx++] = c;
+		}else if(cp < 0){
+			rs->render[idx++] = '?';
+		}else{
+			int j;
+			for(j = 0; j < len; j++) rs->render[idx++] = editorRowCharAt(row, cx + j);
+		}
+		col += cw;
+		cx += len;
+	}
+	editorRenderReserve(rs, idx + 1);
+	rs->render[idx] = '\0';
+	rs->rsize = idx;
+	rs->rstart = w0;
+	rs->rcols = w;
+}
+
+
+struct renderSlot *editorRowRender(erow *row){			// get the render of a row, building it if it s not cached
+	struct renderSlot *rs = editorRowCachedRender(row);
+	int slot;
+	if(rs){
+		slot = row->rslot;
+		if(row->size < MINOCH_LONG_ROW && rs->rcols == 0){
+			editorRenderCacheTouch(slot);
+			return rs;
+		}
+		if(row->size >= MINOCH_LONG_ROW){			// the tab index is good, maybe the window too
+			if(rs->rcols <= 0 || E.coloff < rs->rstart || E.coloff + E.screencols > rs->rstart + rs->rcols)
+				editorRenderWindow(row, rs);
+			editorRenderCacheTouch(slot);
+			return rs;
+		}
+	}
+
+	slot = E.rlru_tail;					// miss : recycle the least recently used slot
+	rs = &E.rcache[slot];
+	char *chars = editorRowData(row);
+	int cp;
+	int j;
+	rs->ntabs = 0;
+	rs->nwide = 0;
+	rs->version = row->version;
+	rs->hlstate = -1;
+	row->rslot = slot;
+	editorRenderCacheTouch(slot);
+
+	int longrow = row->size >= MINOCH_LONG_ROW;		// long row : the tab index for all of it, the render for the screen only
+	if(!longrow) editorRenderReserve(rs, row->size + 1);
+	int idx = 0, col = 0;
+	j = 0;
+	while(j < row->size){
+		int n = editorScanSpecial(chars + j, row->size - j);	// a run of plain ASCII (bytes = columns), skipped 16/32 bytes at a time
+		if(!longrow) memcpy(&rs->render[idx], chars + j, n);
+		idx += n;
+		col += n;
+		j += n;
+		if(j == row->size) break;
+		if(rs->ntabs == rs->tabcap){
+			rs->tabcap = rs->tabcap ? rs->tabcap * 2 : 8;
+			rs->tabs = realloc(rs->tabs, sizeof(struct tabStop) * rs->tabcap);
+			if(rs->tabs == NULL) die("realloc");
+		}
+		struct tabStop *st = &rs->tabs[rs->ntabs++];
+		st->pos = j;
+		if(chars[j] == '\t'){
+			int rend = (col / MINOCH_TAB_STOP + 1) * MINOCH_TAB_STOP;
+			if(!longrow) editorRenderReserve(rs, idx + rend - col + row->size - j);	// the spaces, the rest of the chars, the '\0'
+			if(!longrow) memset(&rs->render[idx], ' ', rend - col);
+			idx += rend - col;
+			st->len = 1;
+			st->width = rend - col;
+			st->tab = 1;
+			col = rend;
+		}else{
+			st->len = editorUtf8Decode(chars + j, row->size - j, &cp);
+			st->width = editorCharWidth(cp);
+			st->tab = 0;
+			if(!longrow && cp < 0) rs->render[idx] = '?';
+			else if(!longrow) memcpy(&rs->render[idx], chars + j, st->len);
+			idx += cp < 0 ? 1 : st->len;
+			col += st->width;
+			rs->nwide++;
+		}
+		st->rend = col;
+		st->rb = longrow ? -1 : idx;
+		j += st->len;
+	}
+	if(longrow){
+		editorRenderWindow(row, rs);
+		return rs;
+	}
+	rs->render[idx] = '\0';
+	rs->rsize = idx;
+	rs->rstart = 0;
+	rs->rcols = 0;
+	return rs;
+}
+
+
+/* the tab index of a render : between two tabs chars and render columns go 1 to 1, so the tabs (where they are and where
+ they end on screen) are all we need to convert columns with a binary search. non ASCII chars get a stop too (see UTF-8).
+ it also lets a one char edit patch the render in place : only the chars up to the next tab that still ends on the same
+ column change, see editorRenderPatch; rows with non ASCII chars are rendered again instead. */
+
+int editorRenderTabsBefore(struct renderSlot *rs, int cx){		// nb of tabs before char cx
+	int lo = 0, hi = rs->ntabs;
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(rs->tabs[mid].pos < cx) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+
+int editorRenderCxToRx(struct renderSlot *rs, int cx){
+	int k = editorRenderTabsBefore(rs, cx);
+	if(k == 0) return cx;
+	struct tabStop *st = &rs->tabs[k - 1];
+	int d = cx - st->pos - st->len;					// < 0 : cx is inside a char, say the column after it
+	return st->rend + (d > 0 ? d : 0);
+}
+
+
+int editorRenderRxToCx(struct renderSlot *rs, int rx){
+	int lo = 0, hi = rs->ntabs;					// nb of tabs that end at or before rx
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(rs->tabs[mid].rend <= rx) lo = mid + 1;
+		else hi = mid;
+	}
+	int cx = lo ? rs->tabs[lo - 1].pos + rs->tabs[lo - 1].len + rx - rs->tabs[lo - 1].rend : rx;
+	if(lo < rs->ntabs && cx > rs->tabs[lo].pos) cx = rs->tabs[lo].pos;	// rx is on the spaces of the next tab (or a wide char)
+	return cx;
+}
+
+
+int editorRenderColByte(struct renderSlot *rs, int col, int *start){	// render byte of the first char starting at or after column
+	int b, c;								// col, its column goes in *start
+	if(col < rs->rstart) col = rs->rstart;
+	if(rs->nwide == 0){
+		b = col - rs->rstart;
+		if(b > rs->rsize) b = rs->rsize;
+		*start = col;
+		return b;
+	}
+	if(rs->rcols == 0){							// whole render : jump to the last stop before col
+		int lo = 0, hi = rs->ntabs;
+		while(lo < hi){
+			int mid = (lo + hi) / 2;
+			if(rs->tabs[mid].rend <= col) lo = mid + 1;
+			else hi = mid;
+		}
+		b = (lo ? rs->tabs[lo - 1].rb : 0) + col - (lo ? rs->tabs[lo - 1].rend : 0);
+		c = col;
+		if(lo < rs->ntabs && !rs->tabs[lo].tab && rs->tabs[lo].rend - rs->tabs[lo].width < col){	// col is in a wide char
+			b = rs->tabs[lo].rb;
+			c = rs->tabs[lo].rend;
+			for(lo++; lo < rs->ntabs && rs->tabs[lo].width == 0 && rs->tabs[lo].rb - rs->tabs[lo].len == b; lo++)
+				b = rs->tabs[lo].rb;					// and its marks
+		}
+		if(b > rs->rsize) b = rs->rsize;
+		*start = c;
+		return b;
+	}
+	b = 0;									// window of a long row : walk it
+	c = rs->rstart;
+	while(b < rs->rsize){
+		int cp, len = editorUtf8Decode(&rs->render[b], rs->rsize - b, &cp);
+		int w = editorCharWidth(cp);
+		if(c >= col && w != 0) break;					// marks go with the char before them
+		b += len;
+		c += w;
+	}
+	*start = c;
+	return b;
+}
+
+
+int editorRenderColEnd(struct renderSlot *rs, int b, int col, int end){	// from byte b (column col) : the byte where the chars that
+	if(rs->nwide == 0){							// fit before column end stop
+		b += end - col;
+		return b > rs->rsize ? rs->rsize : b;
+	}
+	while(b < rs->rsize){
+		int cp, len = editorUtf8Decode(&rs->render[b], rs->rsize - b, &cp);
+		int w = editorCharWidth(cp);
+		if(col + w > end) break;
+		b += len;
+		col += w;
+	}
+	return b;
+}
+
+
+int editorRenderShiftTabs(struct renderSlot *rs, int at, int delta, int tab){	// fix the tab positions for one char inserted
+	int k = editorRenderTabsBefore(rs, at);			// at "at" (delta 1, tab says if it is one) or deleted there (-1),
+	int j;								// returns the first tab after the edit
+	if(delta < 0 && k < rs->ntabs && rs->tabs[k].pos == at){	// a tab went away
+		memmove(&rs->tabs[k], &rs->tabs[k + 1], sizeof(struct tabStop) * (rs->ntabs - k - 1));
+		rs->ntabs--;
+	}
+	for(j = k; j < rs->ntabs; j++) rs->tabs[j].pos += delta;
+	if(delta > 0 && tab){						// a tab came in
+		if(rs->ntabs == rs->tabcap){
+			rs->tabcap = rs->tabcap ? rs->tabcap * 2 : 8;
+			rs->tabs = realloc(rs->tabs, sizeof(struct tabStop) * rs->tabcap);
+			if(rs->tabs == NULL) die("realloc");
+		}
+		memmove(&rs->tabs[k + 1], &rs->tabs[k], sizeof(struct tabStop) * (rs->ntabs - k));
+		rs->tabs[k].pos = at;
+		rs->tabs[k].rend = -1;					// new, can't end where an old one did
+		rs->tabs[k].len = 1;
+		rs->tabs[k].tab = 1;
+		rs->ntabs++;
+	}
+	return k;
+}
+
+
+void editorRenderPatch(erow *row, struct renderSlot *rs, int at, int delta){	// row->chars got one char inserted at "at" (delta 1) or
+	int r0 = editorRenderCxToRx(rs, at);				// the one at "at" deleted (-1); rs is the render from before
+	int k = editorRenderShiftTabs(rs, at, delta, delta > 0 && row->chars[at] == '\t');	// chars before "at" did not move
+	int j;
+
+	editorRenderReserve(rs, rs->rsize + MINOCH_TAB_STOP + 1);	// a new tab is at most that much longer
+	int col = r0, t = k;						// render again from "at" ...
+	for(j = at; j < row->size; j++){
+		if(row->chars[j] != '\t'){
+			rs->render[col++] = row->chars[j];
+			continue;
+		}
+		int rend = (col / MINOCH_TAB_STOP + 1) * MINOCH_TAB_STOP;
+		rs->tabs[t].width = rend - col;
+		while(col < rend) rs->render[col++] = ' ';
+		if(rs->tabs[t].rend == rend) break;			// ... until a tab absorbs the change : the rest did not move
+		rs->tabs[t].rb = rend;					// no wide chars in here : bytes are columns
+		rs->tabs[t++].rend = rend;
+	}
+	if(j == row->size){
+		rs->render[col] = '\0';
+		rs->rsize = col;
+	}
+	rs->version = row->version;
+	rs->hlstate = -1;
+}
+
+
+void editorRenderPatchLong(struct renderSlot *rs, int at, int delta, int tab, unsigned long long version){	// same for a long row :
+	int col = editorRenderCxToRx(rs, at);				// only the tab index, the window is rendered again when drawn
+	int t = editorRenderShiftTabs(rs, at, delta, tab);
+	int prev = at;							// col is the render column of char prev
+	for(; t < rs->ntabs; t++){
+		struct tabStop *st = &rs->tabs[t];
+		int start = col + st->pos - prev;
+		int rend = st->tab ? (start / MINOCH_TAB_STOP + 1) * MINOCH_TAB_STOP : start + st->width;	// wide chars just move along
+		if(st->tab) st->width = rend - start;			// (a tab that still ends there may have grown or shrunk)
+		if(st->rend == rend) break;
+		st->rend = rend;
+		col = rend;
+		prev = st->pos + st->len;
+	}
+	rs->version = version;
+	rs->rcols = -1;
+	rs->hlstate = -1;
+}
+
+
+void editorLongRowEdit(erow *row, int at, int insert, unsigned char c){	// insert c at "at", or delete the char there
+	struct renderSlot *rs = editorRowCachedRender(row);
+	unsigned char old = insert ? c : editorRowCharAt(row, at);
+	int tab = old == '\t';
+	if(rs && old >= 0x80) rs = NULL;				// a byte of a non ASCII char : the index is built again when drawn
+	if(insert){
+		editorRowOpenGap(row, at, 1);
+		row->chars[E.lgap++] = c;
+		E.lgaplen--;
+		row->size++;
+	}else{
+		editorRowOpenGap(row, at, 0);
+		E.lgaplen++;
+		row->size--;
+	}
+	editorUpdateRow(row);
+	if(rs) editorRenderPatchLong(rs, at, insert ? 1 : -1, tab, row->version);
+	E.dirty++;
+}
+
+
+void editorInsertRow(int at, char *s, size_t len) {
+
+  if (at < 0 || at > E.numrows) return;				//validate the index 
+
+  editorRowReserve(1);						// make room for one more erow and put the gap where it goes
+  editorRowMoveGap(at);
+  erow *row = &E.row[at];
+  E.gap++;
+
+  row->size = len;
+  row->chars = editorCharsAlloc(len + 1, &row->ccap);
+  memcpy(row->chars, s, len);
+  row->chars[len] = '\0';
+
+  row->rslot = -1;
+  row->foff = 0;
+
+  E.numrows++;
+  editorSearchRowInserted(at);
+  editorSyntaxRowInserted(at);
+  editorUpdateRow(row);
+  E.dirty++;
+}
+
+
+void editorFreeRow(erow *row) {
+  if(row == E.lrow) E.lrow = NULL;
+  editorCharsFree(row->chars, row->ccap);
+}
+
+
+int editorRowsClose(){							// drop every row and their memory in one go; 0 if the accounting is off
+	size_t live = 0, bytes = 0;
+	int j;
+	editorRowCloseGap();
+	for(j = 0; j < E.numrows; j++){
+		erow *row = editorRowAt(j);
+		if(row->chars == NULL) continue;
+		live++;
+		bytes += row->ccap;
+	}
+	int ok = live == E.rowmem.live && bytes == E.rowmem.livebytes;
+	if(!ok) E.rowmem.leaks++;
+	editorCharsReleaseAll();
+	E.numrows = 0;
+	E.gap = 0;
+	editorWrapRebuild();
+	return ok;
+}
+
+
+void editorDelRow(int at) {
+  if (at < 0 || at >= E.numrows) return;
+  editorSearchRowDeleted(at);
+  editorRowMoveGap(at + 1);					// the deleted row ends up just before the gap, so we only grow the gap by one
+  editorFreeRow(&E.row[at]);
+  editorWrapRowsDeleted(at, 1);
+  E.gap--;
+  E.numrows--;
+  editorSyntaxRowsDeleted(at, 1);
+  E.dirty++;
+}
+
+
+
+
+
+void editorRowInsertChar(erow *row, int at, int c){			//"at" is the index we will insert the char at,
+	if(at < 0 || at > row->size) at = row->size;			
+	if(row->size >= MINOCH_LONG_ROW){
+		editorLongRowEdit(row, at, 1, c);
+		return;
+	}
+	editorRowMaterialize(row);
+	struct renderSlot *rs = editorRowCachedRender(row);		// on screen : we patch its render instead of building it again
+	if(rs && (rs->rcols != 0 || rs->nwide || (unsigned char)c >= 0x80)) rs = NULL;
+	row->chars = editorCharsGrow(row->chars, &row->ccap, row->size + 1, row->size + 2);	// the +2 : 1 byte for the char we will insert the second foe the null byte
+	memmove(&row->chars[at+1], &row->chars[at], row->size-at +1);
+	row->size++;
+	row->chars[at] = c;
+	editorUpdateRow(row);
+	if(rs) editorRenderPatch(row, rs, at, 1);
+	E.dirty++;
+
+}
+
+void editorRowAppendString(erow *row, char *s, size_t len) {	// this function s gonna be used when we delete something from begining of a line, so the content of that line is going up to line above !
+  editorRowMaterialize(row);
+  row->chars = editorCharsGrow(row->chars, &row->ccap, row->size + 1, row->size + len + 1);	//  we need memo for row->size + len + 1 for the null byte
+  memcpy(&row->chars[row->size], s, len);			// we then move the content to the end of above line 
+  row->size += len;						// update new size
+  row->chars[row->size] = '\0';					// add null byte
+  editorUpdateRow(row);						// update the row 
+  E.dirty++;							// dirty bit updated ! 
+}
+
+
+
+
+void editorRowDelChar(erow *row, int at){				//function to delete a character argument at is the index !
+	if(at < 0 || at >= row->size) return;
+	if(row->size >= MINOCH_LONG_ROW){
+		editorLongRowEdit(row, at, 0, 0);
+		return;
+	}
+	editorRowMaterialize(row);
+	struct renderSlot *rs = editorRowCachedRender(row);
+	if(rs && (rs->rcols != 0 || rs->nwide || (unsigned char)row->chars[at] >= 0x80)) rs = NULL;
+	memmove(&row->chars[at], &row->chars[at+1], row->size -at);
+	row->size--;
+	editorUpdateRow(row);
+	if(rs) editorRenderPatch(row, rs, at, -1);
+	E.dirty++;
+}
+
+
+void editorRowInsertString(erow *row, int at, const char *s, int len){	// same as editorRowInsertChar, for many chars with one memmove
+	if(at < 0 || at > row->size) at = row->size;
+	editorRowMaterialize(row);
+	row->chars = editorCharsGrow(row->chars, &row->ccap, row->size + 1, row->size + len + 1);
+	memmove(&row->chars[at + len], &row->chars[at], row->size - at + 1);
+	memcpy(&row->chars[at], s, len);
+	row->size += len;
+	editorUpdateRow(row);
+	E.dirty++;
+}
+
+
+void editorRowDelRange(erow *row, int at, int len){			// delete len chars starting at "at"
+	if(at < 0 || len <= 0 || at + len > row->size) return;
+	editorRowMaterialize(row);
+	memmove(&row->chars[at], &row->chars[at + len], row->size - at - len + 1);
+	row->size -= len;
+	editorUpdateRow(row);
+	E.dirty++;
+}
+
+
+void editorDelRows(int at, int n){					// delete n rows in a row : the gap moves once, then just grows
+	if(at < 0 || n <= 0 || at + n > E.numrows) return;
+	int j;
+	for(j = n - 1; j >= 0; j--) editorSearchRowDeleted(at + j);
+	editorRowMoveGap(at + n);
+	for(j = at; j < at + n; j++) editorFreeRow(&E.row[j]);
+	editorWrapRowsDeleted(at, n);
+	E.gap -= n;
+	E.numrows -= n;
+	editorSyntaxRowsDeleted(at, n);
+	E.dirty++;
+}
+
+
+
+
+/**** Soft wrap ****/
+
+/* Ctrl-W wraps the rows that don't fit the screen width on the next screen lines instead of scrolling sideways. a row takes
+ cols / width + 1 lines (the cursor after its last char needs a place too). to go from a row to the screen line it starts on
+ and back without adding up every row before it, the heights are kept in a Fenwick tree indexed by the slots of E.row : a
+ gap slot is a row of height 0, so adding or removing a row at the gap is one update, and moving the gap moves the heights
+ of the rows it slides over, like the rows themselves. so a row edit, scrolling or a page down cost O(log n).
+ the heights come from the tab index of a row's render when it is cached, else from its size in bytes (exact for plain
+ ASCII, no need to read the file); rows get their exact height when they are drawn. a new screen width rebuilds the tree in
+ one pass, O(rows), again without rendering anything. */
+
+int editorWrapSlot(int at){
+	return at < E.gap ? at : at + (E.rowcap - E.numrows);
+}
+
+
+int editorWrapHeight(erow *row, struct renderSlot *rs){		// screen lines of a row; rs : its render (NULL : use the cache if it has it)
+	if(rs == NULL) rs = editorRowCachedRender(row);
+	long cols = row->size;
+	if(rs && rs->ntabs){
+		struct tabStop *st = &rs->tabs[rs->ntabs - 1];
+		cols = st->rend + row->size - st->pos - st->len;
+	}
+	return cols / E.wrap.cols + 1;
+}
+
+
+void editorWrapAdd(int slot, long delta){
+	int i;
+	for(i = slot + 1; i <= E.wrap.n; i += i & -i) E.wrap.fw[i] += delta;
+}
+
+
+long editorWrapPrefix(int slot){					// lines of the slots before this one
+	long sum = 0;
+	int i;
+	for(i = slot; i > 0; i -= i & -i) sum += E.wrap.fw[i];
+	return sum;
+}
+
+
+long editorWrapGet(int slot){						// height stored for one slot
+	int i = slot + 1;
+	long v = E.wrap.fw[i];
+	int stop = i - (i & -i);
+	for(i--; i > stop; i -= i & -i) v -= E.wrap.fw[i];
+	return v;
+}
+
+
+long editorWrapLine(int at){						// screen line row "at" starts on, counted from the start of the file
+	return editorWrapPrefix(editorWrapSlot(at));
+}
+
+
+int editorWrapFind(long line, int *sub){				// the row screen line "line" belongs to, *sub : which of its lines
+	int pos = 0, step = 1;
+	while(step * 2 <= E.wrap.n) step *= 2;
+	for(; step; step /= 2){
+		if(pos + step <= E.wrap.n && E.wrap.fw[pos + step] <= line){
+			pos += step;
+			line -= E.wrap.fw[pos];
+		}
+	}
+	*sub = line;
+	return pos < E.gap ? pos : pos - (E.rowcap - E.numrows);
+}
+
+
+void editorWrapRebuild(){						// every height again, in one pass
+	struct wrapIndex *W = &E.wrap;
+	if(!W->on) return;
+	if(W->n != E.rowcap){
+		free(W->fw);
+		W->fw = malloc(sizeof(long) * (E.rowcap + 1));
+		if(W->fw == NULL) die("malloc");
+		W->n = E.rowcap;
+	}
+	W->cols = E.screencols > 0 ? E.screencols : 1;
+	int gapend = E.gap + E.rowcap - E.numrows, i;
+	W->fw[0] = 0;
+	for(i = 1; i <= W->n; i++) W->fw[i] = i - 1 >= E.gap && i - 1 < gapend ? 0 : editorWrapHeight(&E.row[i - 1], NULL);
+	for(i = 1; i <= W->n; i++){					// each node adds itself to its parent : O(n) build
+		int p = i + (i & -i);
+		if(p <= W->n) W->fw[p] += W->fw[i];
+	}
+}
+
+
+void editorWrapSet(int at, long h){
+	int slot = editorWrapSlot(at);
+	long old = editorWrapGet(slot);
+	if(old != h) editorWrapAdd(slot, h - old);
+}
+
+
+void editorWrapRowChanged(int at){
+	if(E.wrap.on) editorWrapSet(at, editorWrapHeight(editorRowAt(at), NULL));
+}
+
+
+void editorWrapRowsDeleted(int at, int n){				// rows at .. at + n - 1 sit right before the gap and are about to join it
+	int j;
+	if(!E.wrap.on) return;
+	for(j = at; j < at + n; j++){
+		long h = editorWrapGet(j);
+		if(h) editorWrapAdd(j, -h);
+	}
+}
+
+
+void editorWrapSlotsMoved(int from, int count, int shift){		// the gap moved : count rows went from slot from to from + shift
+	int j;
+	if(!E.wrap.on || shift == 0) return;
+	if(count > E.wrap.n / 16){					// cheaper to do it all again
+		editorWrapRebuild();
+		return;
+	}
+	for(j = 0; j < count; j++){					// the slot each row goes to is free by then : in the gap or already moved
+		int s = shift > 0 ? from + count - 1 - j : from + j;
+		long h = editorWrapGet(s);
+		if(h == 0) continue;
+		editorWrapAdd(s, -h);
+		editorWrapAdd(s + shift, h);
+	}
+}
+
+
+int editorWrapExact(int at, struct renderSlot *rs){			// the real height of a row we render anyway
+	int h = editorWrapHeight(editorRowAt(at), rs);
+	editorWrapSet(at, h);
+	return h;
+}
+
+
+void editorWrapToggle(){
+	struct wrapIndex *W = &E.wrap;
+	if(W->on){
+		W->on = 0;
+		free(W->fw);
+		W->fw = NULL;
+		W->n = 0;
+		editorSetStatusMessage("Soft wrap off");
+		return;
+	}
+	W->on = 1;
+	W->off = 0;
+	editorWrapRebuild();
+	E.coloff = 0;
+	editorSetStatusMessage("Soft wrap on, Ctrl-W to turn it off");
+}
+
+
+void editorWrapScroll(){						// editorScroll when wrapped : the screen starts at line E.wrap.off of row E.rowoff
+	struct wrapIndex *W = &E.wrap;
+	if(W->cols != E.screencols) editorWrapRebuild();
+	int w = W->cols;
+	E.coloff = 0;
+	if(E.rowoff > E.numrows) E.rowoff = E.numrows;
+	if(E.rowoff < E.numrows){
+		int h = editorWrapExact(E.rowoff, editorRowRender(editorRowAt(E.rowoff)));
+		if(W->off >= h) W->off = h - 1;
+	}else{
+		W->off = 0;
+	}
+	if(E.cy < E.numrows) editorWrapExact(E.cy, editorRowRender(editorRowAt(E.cy)));
+	int r;
+	if(E.cy > E.rowoff && E.cy - E.rowoff < E.screenrows)		// the rows between the top and the cursor are on screen : exact heights
+		for(r = E.rowoff; r < E.cy; r++) editorWrapExact(r, editorRowRender(editorRowAt(r)));
+	long top = editorWrapLine(E.rowoff) + W->off;
+	long cur = editorWrapLine(E.cy) + E.rx / w;
+	if(cur < top){
+		top = cur;
+	}else if(cur >= top + E.screenrows){				// the cursor goes on the last line : the rows above it fill the screen
+		long need = E.rx / w + 1;
+		for(r = E.cy - 1; r >= 0 && need < E.screenrows; r--) need += editorWrapExact(r, editorRowRender(editorRowAt(r)));
+		top = editorWrapLine(E.cy) + E.rx / w - E.screenrows + 1;
+		if(top < 0) top = 0;
+		cur = editorWrapLine(E.cy) + E.rx / w;
+	}
+	if(top >= editorWrapLine(E.numrows)){
+		E.rowoff = E.numrows;
+		W->off = 0;
+	}else{
+		E.rowoff = editorWrapFind(top, &W->off);
+	}
+	W->cury = cur - top;
+	W->curx = E.rx % w;
+}
+
+
+void editorWrapPage(int dir){						// page up / down by screen lines, not rows
+	struct wrapIndex *W = &E.wrap;
+	if(W->cols != E.screencols) editorWrapRebuild();
+	int w = W->cols;
+	int rx = E.cy < E.numrows ? editorRowCxToRx(editorRowAt(E.cy), E.cx) : 0;
+	long total = editorWrapLine(E.numrows);
+	long cur = editorWrapLine(E.cy) + rx / w + (long)dir * E.screenrows;
+	long top = (E.rowoff < E.numrows ? editorWrapLine(E.rowoff) + W->off : total) + (long)dir * E.screenrows;
+	if(cur < 0) cur = 0;
+	if(cur > total) cur = total;
+	if(top < 0) top = 0;
+	if(top > total) top = total;
+	int sub;
+	if(cur == total){
+		E.cy = E.numrows;
+		E.cx = 0;
+	}else{
+		E.cy = editorWrapFind(cur, &sub);
+		E.cx = editorRowRxToCx(editorRowAt(E.cy), sub * w + rx % w);
+	}
+	if(top == total){
+		E.rowoff = E.numrows;
+		W->off = 0;
+	}else{
+		E.rowoff = editorWrapFind(top, &W->off);		// the text moves by a page, the cursor stays on the same screen line
+	}
+}
+
+
+
+
+/**** Syntax highlighting ****/
+
+/* rows are highlighted when drawn, from their render, and the result stays in their render cache slot. the only thing a
+ row needs from the rows above is whether it starts inside a comment : every row keeps the state it started and ended in.
+ rows before E.hl_clean are known good; an edit pulls E.hl_clean back to the edited row, and the next draw lexes again from
+ there only until a row ends in the same state as before, then jumps back to E.hl_high. typing in a 500k lines file lexes
+ a row or two, and rows that are never shown are never highlighted. a jump far below E.hl_clean does not lex everything in
+ between before drawing : the state is guessed from the MINOCH_SYNTAX_GUESS rows above (a comment is rarely longer), and
+ the exact walk catches up while we wait for keys, MINOCH_SYNTAX_SLICE rows at a time, see editorSyntaxIdle. */
+
+int editorIsSeparator(int c){
+	return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[]{};:!&|^?", c) != NULL;
+}
+
+
+int editorSyntaxLex(const char *s, int len, int state, unsigned char *hl){	// highlight a line starting in state, returns the end state
+	struct editorSyntax *syn = E.syntax;
+	char **keywords = syn->keywords;
+	char *scs = syn->singleline_comment_start;
+	char *mcs = syn->multiline_comment_start;
+	char *mce = syn->multiline_comment_end;
+	int scs_len = scs ? strlen(scs) : 0;
+	int mcs_len = mcs ? strlen(mcs) : 0;
+	int mce_len = mce ? strlen(mce) : 0;
+
+	memset(hl, HL_NORMAL, len);
+	int prev_sep = 1;
+	int in_string = 0;
+	int in_comment = state;
+	int i = 0;
+	while(i < len){
+		char c = s[i];
+		unsigned char prev_hl = i > 0 ? hl[i - 1] : HL_NORMAL;
+
+		if(scs_len && !in_string && !in_comment && i + scs_len <= len && !strncmp(&s[i], scs, scs_len)){
+			memset(&hl[i], HL_COMMENT, len - i);
+			break;
+		}
+
+		if(mcs_len && mce_len && !in_string){
+			if(in_comment){
+				hl[i] = HL_MLCOMMENT;
+				if(i + mce_len <= len && !strncmp(&s[i], mce, mce_len)){
+					memset(&hl[i], HL_MLCOMMENT, mce_len);
+					i += mce_len;
+					in_comment = 0;
+					prev_sep = 1;
+				}else{
+					i++;
+				}
+				continue;
+			}else if(i + mcs_len <= len && !strncmp(&s[i], mcs, mcs_len)){
+				memset(&hl[i], HL_MLCOMMENT, mcs_len);
+				i += mcs_len;
+				in_comment = 1;
+				continue;
+			}
+		}
+
+		if(syn->flags & HL_HIGHLIGHT_STRINGS){
+			if(in_string){
+				hl[i] = HL_STRING;
+				if(c == '\\' && i + 1 < len){
+					hl[i + 1] = HL_STRING;
+					i += 2;
+					continue;
+				}
+				if(c == in_string) in_string = 0;
+				i++;
+				prev_sep = 1;
+				continue;
+			}else if(c == '"' || c == '\''){
+				in_string = c;
+				hl[i++] = HL_STRING;
+				continue;
+			}
+		}
+
+		if(syn->flags & HL_HIGHLIGHT_NUMBERS){
+			if((isdigit((unsigned char)c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)){
+				hl[i++] = HL_NUMBER;
+				prev_sep = 0;
+				continue;
+			}
+		}
+
+		if(prev_sep){
+			int j;
+			for(j = 0; keywords[j]; j++){
+				int klen = strlen(keywords[j]);
+				int kw2 = keywords[j][klen - 1] == '|';
+				if(kw2) klen--;
+				if(i + klen <= len && !strncmp(&s[i], keywords[j], klen) && editorIsSeparator(i + klen < len ? s[i + klen] : '\0')){
+					memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+					i += klen;
+					break;
+				}
+			}
+			if(keywords[j] != NULL){
+				prev_sep = 0;
+				continue;
+			}
+		}
+
+		prev_sep = editorIsSeparator(c);
+		i++;
+	}
+	return in_comment;
+}
+
+
+int editorSyntaxLexState(const char *s, int len, int state){	// the end state only, for rows we don't draw : editorSyntaxLex
+	struct editorSyntax *syn = E.syntax;				// without the keywords and numbers (no quote nor comment in them)
+	char *scs = syn->singleline_comment_start;
+	char *mcs = syn->multiline_comment_start;
+	char *mce = syn->multiline_comment_end;
+	int scs_len = scs ? strlen(scs) : 0;
+	int mcs_len = mcs ? strlen(mcs) : 0;
+	int mce_len = mce ? strlen(mce) : 0;
+	int in_string = 0;
+	int in_comment = state;
+	int i = 0;
+	while(i < len){
+		char c = s[i];
+		if(scs_len && !in_string && !in_comment && i + scs_len <= len && !strncmp(&s[i], scs, scs_len)) break;
+		if(mcs_len && mce_len && !in_string){
+			if(in_comment){
+				if(i + mce_len <= len && !strncmp(&s[i], mce, mce_len)){
+					i += mce_len;
+					in_comment = 0;
+				}else{
+					i++;
+				}
+				continue;
+			}else if(i + mcs_len <= len && !strncmp(&s[i], mcs, mcs_len)){
+				i += mcs_len;
+				in_comment = 1;
+				continue;
+			}
+		}
+		if(syn->flags & HL_HIGHLIGHT_STRINGS){
+			if(in_string){
+				if(c == '\\' && i + 1 < len){
+					i += 2;
+					continue;
+				}
+				if(c == in_string) in_string = 0;
+			}else if(c == '"' || c == '\''){
+				in_string = c;
+			}
+		}
+		i++;
+	}
+	return in_comment;
+}
+
+
+void editorSyntaxLexRow(erow *row, int state){				// set the end state of a row we don't draw
+	row->hl_start = row->hl_end = state;
+	row->hl_ok = 1;
+	if(row->size >= MINOCH_LONG_ROW) return;			// long rows are not highlighted, the state goes through
+	row->hl_end = editorSyntaxLexState(editorRowData(row), row->size, state);
+}
+
+
+int editorSyntaxWalk(int at, int budget){				// move E.hl_clean towards "at", lexing at most budget rows;
+	int state = E.hl_clean > 0 ? editorRowAt(E.hl_clean - 1)->hl_end : 0;	// returns the state E.hl_clean starts in
+	while(E.hl_clean < at && budget > 0){
+		erow *row = editorRowAt(E.hl_clean);
+		if(row->hl_ok && row->hl_start == state){
+			if(E.hl_clean > E.hl_dirty_hi && E.hl_high > E.hl_clean + 1){	// past the edits and nothing changed : the rest is still good
+				E.hl_clean = E.hl_high < at ? E.hl_high : at;
+				state = editorRowAt(E.hl_clean - 1)->hl_end;
+				continue;
+			}
+		}else{
+			editorSyntaxLexRow(row, state);
+			budget--;
+		}
+		state = row->hl_end;
+		E.hl_clean++;
+	}
+	if(E.hl_clean > E.hl_high) E.hl_high = E.hl_clean;
+	if(E.hl_clean > E.hl_dirty_hi) E.hl_dirty_hi = -1;		// every edited row is behind us, the next edit starts over
+	return state;
+}
+
+
+int editorSyntaxStartState(int at){					// the state row "at" starts in, lexing the rows above it if needed
+	if(E.syntax == NULL || E.syntax->multiline_comment_start == NULL) return 0;	// no state crosses lines
+	if(at <= E.hl_clean) return at > 0 ? editorRowAt(at - 1)->hl_end : 0;
+	if(at - E.hl_clean <= MINOCH_SYNTAX_GUESS) return editorSyntaxWalk(at, at - E.hl_clean);
+
+	erow *prev = editorRowAt(at - 1);				// too far : a guess, good enough to draw
+	if(prev->hl_ok) return prev->hl_end;				// (the row above is on screen too, or was lexed before)
+	int j = at - MINOCH_SYNTAX_GUESS, state = 0;			// lex the rows above from "not in a comment"
+	if(E.hl_high > j) E.hl_high = j;				// they don't follow the rows before them : no jump over them
+	for(; j < at; j++){
+		erow *row = editorRowAt(j);
+		editorSyntaxLexRow(row, state);
+		state = row->hl_end;
+	}
+	return state;
+}
+
+
+int editorSyntaxBehind(){						// the screen was drawn with a guessed state, see editorSyntaxStartState
+	if(E.syntax == NULL || E.syntax->multiline_comment_start == NULL) return 0;
+	return E.hl_clean < (E.rowoff < E.numrows ? E.rowoff : E.numrows);
+}
+
+
+int editorSyntaxIdle(){							// we wait for a key (E.rowlock is free) : lex a slice more of the
+	pthread_rwlock_wrlock(&E.rowlock);				// rows above the screen; 1 once they are all done, time to redraw
+	int top = E.rowoff < E.numrows ? E.rowoff : E.numrows;
+	editorSyntaxWalk(top, MINOCH_SYNTAX_SLICE);
+	int done = E.hl_clean >= top;
+	pthread_rwlock_unlock(&E.rowlock);
+	return done;
+}
+
+
+unsigned char *editorRowHighlight(erow *row, int at, struct renderSlot *rs){	// highlight of a row we draw, NULL if the file has none
+	if(E.syntax == NULL) return NULL;
+	int state = editorSyntaxStartState(at);
+	if(row->size >= MINOCH_LONG_ROW){
+		row->hl_start = row->hl_end = state;
+		row->hl_ok = 1;
+		return NULL;
+	}
+	if(rs->hlstate != state){
+		if(rs->hlcap < rs->rsize + 1){
+			rs->hl = realloc(rs->hl, rs->cap);
+			if(rs->hl == NULL) die("realloc");
+			rs->hlcap = rs->cap;
+		}
+		row->hl_start = state;
+		row->hl_end = editorSyntaxLex(rs->render, rs->rsize, state, rs->hl);	// tabs are spaces either way : same end state as the chars
+		row->hl_ok = 1;
+		rs->hlstate = state;
+	}
+	return rs->hl;
+}
+
+
+void editorSyntaxRowChanged(int at){					// row "at" changed, or rows were inserted / deleted there
+	if(at < E.hl_clean) E.hl_clean = at;
+	if(at > E.hl_dirty_hi) E.hl_dirty_hi = at;
+}
+
+
+void editorSyntaxRowInserted(int at){
+	if(E.hl_high > at) E.hl_high++;
+	if(E.hl_dirty_hi >= at) E.hl_dirty_hi++;
+	editorSyntaxRowChanged(at);
+}
+
+
+void editorSyntaxRowsDeleted(int at, int n){
+	if(E.hl_high > at) E.hl_high = E.hl_high - n > at ? E.hl_high - n : at;
+	if(E.hl_dirty_hi >= at) E.hl_dirty_hi = E.hl_dirty_hi - n > at ? E.hl_dirty_hi - n : at;
+	editorSyntaxRowChanged(at);					// the row that comes next may now start in another state
+}
+
+
+int editorSyntaxToColor(int hl){
+	switch(hl){
+		case HL_COMMENT:
+		case HL_MLCOMMENT: return 36;
+		case HL_KEYWORD1: return 33;
+		case HL_KEYWORD2: return 32;
+		case HL_STRING: return 35;
+		case HL_NUMBER: return 31;
+		default: return 37;
+	}
+}
+
+
+void editorSelectSyntaxHighlight(){					// pick the file type from the file name
+	struct editorSyntax *old = E.syntax;
+	E.syntax = NULL;
+	if(E.filename != NULL){
+		char *ext = strrchr(E.filename, '.');
+		unsigned int j;
+		for(j = 0; j < HLDB_ENTRIES && E.syntax == NULL; j++){
+			struct editorSyntax *s = &HLDB[j];
+			int i;
+			for(i = 0; s->filematch[i]; i++){
+				int is_ext = s->filematch[i][0] == '.';
+				if((is_ext && ext && !strcmp(ext, s->filematch[i])) || (!is_ext && strstr(E.filename, s->filematch[i]))){
+					E.syntax = s;
+					break;
+				}
+			}
+		}
+	}
+	if(E.syntax == old) return;
+	int j;
+	for(j = 0; j < E.numrows; j++) editorRowAt(j)->hl_ok = 0;	// states of the old file type mean nothing now
+	for(j = 0; j < E.rcachelen; j++) E.rcache[j].hlstate = -1;
+	E.hl_clean = E.hl_high = 0;
+	E.hl_dirty_hi = -1;
+}
+
+
+
+/**** Editor Operations ****/
+
+
+void editorInsertChar(int c){
+	char ch = c;
+	editorUndoInsert(E.cy, E.cx, &ch, 1);
+	if(E.cy == E.numrows){				// if we'r at the end of the file 
+		editorInsertRow(E.numrows, "", 0);		// then we append a new row before inserting in it
+	}
+	editorRowInsertChar(editorRowAt(E.cy), E.cx, c);
+	E.cx++;
+}
+
+
+void editorInsertNewline(){
+	editorUndoInsert(E.cy, E.cx, "\n", E.cy < E.numrows);		// past the last row, the new line is the row we add (see editorUndoInsert)
+
+	if(E.cx == 0 ){						// if we'r at the begining of a line,  insert a blank row 
+		editorInsertRow(E.cy, "", 0);
+	}else{
+	  erow *row = editorRowAt(E.cy);
+	  editorRowMaterialize(row);
+	  editorInsertRow(E.cy +1, &row->chars[E.cx], row->size - E.cx);
+	  row = editorRowAt(E.cy);				// inserting may have moved the rows around, get the pointer again
+	  row->size = E.cx;
+	  row->chars[row->size] = '\0';
+	  editorUpdateRow(row);
+	}
+	E.cy++;
+	E.cx =0;
+}
+
+
+
+
+
+void editorDelChar(){
+
+	if(E.cy == E.numrows)	return;					// if the cursor went after the end of the file, we just return  
+	if (E.cx == 0 && E.cy == 0) return;				//
+
+
+	erow *row = editorRowAt(E.cy);					// we get the errow where the cursor is ..
+	if(E.cx > 0){							//if we'r not at the begining of the line 
+		char c[4];
+		int n = E.cx - 1, j;					// the bytes of the char before the cursor (only that code point,
+		while(n > 0 && E.cx - n < 4 && ((unsigned char)editorRowCharAt(row, n) & 0xC0) == 0x80) n--;	// not its marks)
+		int cp;
+		if(n + editorRowDecodeAt(row, n, &cp) != E.cx) n = E.cx - 1;
+		for(j = n; j < E.cx; j++) c[j - n] = editorRowCharAt(row, j);
+		editorUndoDelete(E.cy, n, E.cy, E.cx, c, E.cx - n);
+		for(j = n; j < E.cx; j++) editorRowDelChar(row, n);	// delete char and
+		E.cx = n;						//move the cursor back ! 
+	} else {
+    	erow *prev = editorRowAt(E.cy - 1);
+    	editorUndoDelete(E.cy - 1, prev->size, E.cy, 0, "\n", 1);
+    	E.cx = prev->size;
+    	editorRowAppendString(prev, editorRowData(row), row->size);
+    	editorDelRow(E.cy);
+    	E.cy--;
+  	}
+}
+
+
+
+
+
+
+
+/* text level edits : insert or delete any text (newlines included) at a position. undo/redo use them, so a 100k lines paste
+ is undone by deleting 100k rows in one go (the rows gap moves once) instead of going char by char. */
+
+void editorInsertText(int r, int c, const char *s, int len, int *er, int *ec){	// insert s at (r, c), tells where the inserted text ends
+	if(r >= E.numrows){
+		r = E.numrows;
+		editorInsertRow(E.numrows, "", 0);
+	}
+	erow *row = editorRowAt(r);
+	if(c > row->size) c = row->size;
+	const char *end = s + len;
+	const char *nl = memchr(s, '\n', len);
+	if(nl == NULL){
+		editorRowInsertString(row, c, s, len);
+		*er = r;
+		*ec = c + len;
+		return;
+	}
+
+	editorRowMaterialize(row);
+	int taillen = row->size - c;					// what was after c goes at the end of the last inserted line
+	char *tail = malloc(taillen + 1);
+	if(tail == NULL) die("malloc");
+	memcpy(tail, &row->chars[c], taillen);
+	row->size = c;
+	row->chars[c] = '\0';
+	editorRowAppendString(row, (char *)s, nl - s);
+
+	const char *p = nl + 1;
+	while((nl = memchr(p, '\n', end - p)) != NULL){			// the full lines in the middle
+		editorInsertRow(++r, (char *)p, nl - p);
+		p = nl + 1;
+	}
+	editorInsertRow(++r, (char *)p, end - p);
+	editorRowAppendString(editorRowAt(r), tail, taillen);
+	free(tail);
+	*er = r;
+	*ec = end - p;
+}
+
+
+char *editorCopyText(int r0, int c0, int r1, int c1, int *len){	// the text between two positions, lines joined with '\n'
+	size_t total = 0;
+	int r;
+	for(r = r0; r <= r1; r++){
+		erow *row = editorRowAt(r);
+		int from = r == r0 ? c0 : 0, to = r == r1 ? c1 : row->size;
+		total += to - from + (r < r1);
+	}
+	char *buf = malloc(total + 1), *p = buf;
+	if(buf == NULL) die("malloc");
+	for(r = r0; r <= r1; r++){
+		erow *row = editorRowAt(r);
+		int from = r == r0 ? c0 : 0, to = r == r1 ? c1 : row->size;
+		memcpy(p, editorRowData(row) + from, to - from);
+		p += to - from;
+		if(r < r1) *p++ = '\n';
+	}
+	*p = '\0';
+	*len = total;
+	return buf;
+}
+
+
+void editorDeleteText(int r0, int c0, int r1, int c1){		// delete from (r0, c0) up to (r1, c1) excluded
+	if(r0 == r1){
+		editorRowDelRange(editorRowAt(r0), c0, c1 - c0);
+		return;
+	}
+	erow *last = editorRowAt(r1);
+	editorRowMaterialize(last);
+	erow *first = editorRowAt(r0);
+	editorRowMaterialize(first);
+	first->size = c0;						// cut the first row and glue the end of the last one to it
+	first->chars[c0] = '\0';
+	editorRowAppendString(first, &last->chars[c1], last->size - c1);
+	editorDelRows(r0 + 1, r1 - r0);
+}
+
+
+
+/**** Undo ****/
+
+/* every edit is recorded as "text inserted at" or "text deleted at" in an arena (big chunks, records laid end to end), so
+ recording costs no malloc per keypress. typed chars (and backspaces) next to the last record are merged into it. undo/redo
+ replay whole groups (one user action) with editorInsertText / editorDeleteText, so their cost only depends on the edit size.
+ past MINOCH_UNDO_LIMIT bytes the oldest chunks (the oldest actions) are freed. */
+
+void editorUndoFreeChunks(struct undoChunk *c){
+	while(c){
+		struct undoChunk *next = c->next;
+		E.undo.bytes -= c->size;
+		free(c);
+		c = next;
+	}
+}
+
+
+int editorUndoInChunk(struct undoChunk *c, struct undoRec *rec){
+	return (char *)rec >= c->mem && (char *)rec < c->mem + c->size;
+}
+
+
+void editorUndoTruncate(){						// a new edit was made : what could be redone is lost
+	struct undoLog *U = &E.undo;
+	if(U->cur == U->nrecs) return;
+	struct undoRec *rec = U->recs[U->cur];			// the redo records are the last ones in the arena
+	struct undoChunk *c = U->head;
+	while(!editorUndoInChunk(c, rec)) c = c->next;
+	editorUndoFreeChunks(c->next);
+	c->next = NULL;
+	c->used = (char *)rec - c->mem;
+	U->tail = c;
+	U->nrecs = U->cur;
+}
+
+
+void editorUndoEvict(){							// drop the oldest chunks while we are over the limit
+	struct undoLog *U = &E.undo;
+	while(U->bytes > MINOCH_UNDO_LIMIT && U->head != U->tail){
+		struct undoChunk *c = U->head;
+		while(U->first < U->nrecs && editorUndoInChunk(c, U->recs[U->first])) U->first++;
+		while(U->first < U->nrecs && !U->recs[U->first]->group) U->first++;	// never keep half an action
+		if(U->cur < U->first) U->cur = U->first;
+		U->head = c->next;
+		c->next = NULL;
+		editorUndoFreeChunks(c);
+	}
+	if(U->first > U->cap / 2){					// slide the index back to the start once in a while
+		memmove(U->recs, U->recs + U->first, sizeof(struct undoRec *) * (U->nrecs - U->first));
+		U->nrecs -= U->first;
+		U->cur -= U->first;
+		U->first = 0;
+	}
+}
+
+
+struct undoRec *editorUndoAlloc(int cap){				// room for a new record with cap bytes of text at the end of the arena
+	struct undoLog *U = &E.undo;
+	size_t need = (sizeof(struct undoRec) + cap + 7) & ~(size_t)7;
+	if(U->tail == NULL || U->tail->used + need > U->tail->size){
+		size_t size = need > MINOCH_UNDO_CHUNK ? need : MINOCH_UNDO_CHUNK;
+		struct undoChunk *c = malloc(sizeof(struct undoChunk) + size);
+		if(c == NULL) die("malloc");
+		c->next = NULL;
+		c->used = 0;
+		c->size = size;
+		if(U->tail) U->tail->next = c;
+		else U->head = c;
+		U->tail = c;
+		U->bytes += size;
+	}
+	struct undoRec *rec = (struct undoRec *)(U->tail->mem + U->tail->used);
+	U->tail->used += need;
+	rec->cap = need - sizeof(struct undoRec);
+
+	if(U->nrecs == U->cap){
+		U->cap = U->cap ? U->cap * 2 : 1024;
+		U->recs = realloc(U->recs, sizeof(struct undoRec *) * U->cap);
+		if(U->recs == NULL) die("realloc");
+	}
+	U->recs[U->nrecs++] = rec;
+	U->cur = U->nrecs;
+	return rec;
+}
+
+
+void editorUndoAdd(int type, int r, int c, int er, int ec, const char *s, int len){
+	struct undoLog *U = &E.undo;
+	struct undoRec *rec = editorUndoAlloc(len);
+	rec->type = type;
+	rec->group = U->ingroup <= 1;					// first record of a group (or no group at all)
+	if(U->ingroup) U->ingroup = 2;
+	rec->row = r;
+	rec->col = c;
+	rec->erow = er;
+	rec->ecol = ec;
+	rec->len = len;
+	memcpy(rec->text, s, len);
+	U->sealed = 0;
+	editorUndoEvict();
+}
+
+
+struct undoRec *editorUndoLast(int type){				// the last record if the next edit may be merged in it
+	struct undoLog *U = &E.undo;
+	if(U->sealed || U->cur == U->first || U->cur != U->nrecs) return NULL;
+	struct undoRec *rec = U->recs[U->cur - 1];
+	if(rec->type != type || rec->len >= MINOCH_UNDO_COALESCE) return NULL;
+	return rec;
+}
+
+
+void editorUndoInsert(int r, int c, const char *s, int len){	// record that s is about to be inserted at (r, c)
+	struct undoLog *U = &E.undo;
+	editorJournalInsert(r, c, s, len);
+	if(U->replaying) return;
+	editorUndoTruncate();
+	char *buf = NULL;
+	if(r == E.numrows && r > 0){					// typing past the last row adds a row : that is a newline at the end of the last one
+		buf = malloc(len + 1);
+		if(buf == NULL) die("malloc");
+		buf[0] = '\n';
+		memcpy(buf + 1, s, len);
+		s = buf;
+		len++;
+		r--;
+		c = editorRowAt(r)->size;
+	}
+	int er = r, ec = c, j, grow = (len + 7) & ~7;
+	for(j = 0; j < len; j++){
+		if(s[j] == '\n'){ er++; ec = 0; }
+		else ec++;
+	}
+	struct undoRec *rec = editorUndoLast(UNDO_INSERT);
+	if(rec && rec->erow == r && rec->ecol == c && rec->len + len <= rec->cap){	// typing right after the last insert : extend it
+		memcpy(rec->text + rec->len, s, len);
+		rec->len += len;
+		rec->erow = er;
+		rec->ecol = ec;
+	}else if(rec && rec->erow == r && rec->ecol == c && U->tail->used + grow <= U->tail->size
+		&& (char *)rec + sizeof(struct undoRec) + rec->cap == U->tail->mem + U->tail->used){	// no room left but it is the last thing in the arena : grow it
+		U->tail->used += grow;
+		rec->cap += grow;
+		memcpy(rec->text + rec->len, s, len);
+		rec->len += len;
+		rec->erow = er;
+		rec->ecol = ec;
+	}else{
+		editorUndoAdd(UNDO_INSERT, r, c, er, ec, s, len);
+	}
+	free(buf);
+}
+
+
+void editorUndoDelete(int r, int c, int er, int ec, const char *s, int len){	// record that s, from (r, c) to (er, ec), is about to be deleted
+	struct undoLog *U = &E.undo;
+	editorJournalDelete(r, c, er, ec);
+	if(U->replaying) return;
+	editorUndoTruncate();
+	struct undoRec *rec = editorUndoLast(UNDO_DELETE);
+	if(rec && rec->row == er && rec->col == ec && rec->len + len <= rec->cap){	// backspace right before the last delete : prepend
+		memmove(rec->text + len, rec->text, rec->len);
+		memcpy(rec->text, s, len);
+		rec->len += len;
+		rec->row = r;
+		rec->col = c;
+	}else{
+		editorUndoAdd(UNDO_DELETE, r, c, er, ec, s, len);
+	}
+}
+
+
+void editorUndoReplace(const char *text, int len, int flen, int tlen){	// record a replace-all about to be done, text : see Replace
+	const int *m = (const int *)text;
+	editorJournalReplace(text, len, flen, tlen);
+	if(E.undo.replaying) return;
+	editorUndoTruncate();
+	editorUndoAdd(UNDO_REPLACE, m[0], m[1], flen, tlen, text, len);
+	editorUndoSeal();						// nothing typed after it is merged in it
+}
+
+
+void editorUndoSeal(){							// the next edit starts a new record (the cursor moved, ...)
+	E.undo.sealed = 1;
+}
+
+
+void editorUndoBeginGroup(){						// the records until editorUndoEndGroup are undone together
+	editorUndoSeal();
+	E.undo.ingroup = 1;
+}
+
+
+void editorUndoEndGroup(){
+	E.undo.ingroup = 0;
+	editorUndoSeal();
+}
+
+
+void editorUndoApply(struct undoRec *rec, int undo){			// replay a record forward (redo) or backward (undo)
+	int er, ec;
+	if(rec->type == UNDO_REPLACE){					// every match of a replace-all in one go
+		editorReplaceUndo(rec, undo);
+	}else if((rec->type == UNDO_INSERT) == !undo){			// (re)insert the text, cursor after it
+		editorJournalInsert(rec->row, rec->col, rec->text, rec->len);
+		editorInsertText(rec->row, rec->col, rec->text, rec->len, &er, &ec);
+		E.cy = er;
+		E.cx = ec;
+	}else{								// remove it, cursor where it was
+		editorJournalDelete(rec->row, rec->col, rec->erow, rec->ecol);
+		editorDeleteText(rec->row, rec->col, rec->erow, rec->ecol);
+		E.cy = rec->row;
+		E.cx = rec->col;
+	}
+}
+
+
+void editorUndo(){
+	struct undoLog *U = &E.undo;
+	if(U->cur == U->first){
+		editorSetStatusMessage("Nothing to undo");
+		return;
+	}
+	U->replaying = 1;
+	struct undoRec *rec;
+	do{
+		rec = U->recs[--U->cur];
+		editorUndoApply(rec, 1);
+	}while(!rec->group && U->cur > U->first);
+	U->replaying = 0;
+	editorUndoSeal();
+}
+
+
+void editorRedo(){
+	struct undoLog *U = &E.undo;
+	if(U->cur == U->nrecs){
+		editorSetStatusMessage("Nothing to redo");
+		return;
+	}
+	U->replaying = 1;
+	do{
+		editorUndoApply(U->recs[U->cur++], 0);
+	}while(U->cur < U->nrecs && !U->recs[U->cur]->group);
+	U->replaying = 0;
+	editorUndoSeal();
+}
+
+
+
+/**** Journal ****/
+
+/* every edit is also appended to a journal next to the file (.name.minoch-journal) : text inserted or deleted at (row, col),
+ like the undo records, so what it costs depends on what was typed, not on the file size. a thread writes the records and
+ fdatasync's them in batches, once per MINOCH_JOURNAL_MS, the editor never waits for the disk. a save (the file has every
+ edit now) or a normal exit removes the journal; after a crash it is still there and the next minoch on the file replays it,
+ if the file didn't change since (the journal starts with its size, mtime and inode). the replayed edits are one undo step. */
+
+uint32_t editorJournalHash(uint32_t h, const void *p, size_t n){	// FNV-1a, going on from h
+	const unsigned char *s = p;
+	while(n--){
+		h ^= *s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+char *editorJournalPath(const char *filename){
+	const char *slash = strrchr(filename, '/');
+	int dirlen = slash ? slash - filename + 1 : 0;
+	char *path = malloc(strlen(filename) + 20);
+	if(path == NULL) die("malloc");
+	sprintf(path, "%.*s.%s.minoch-journal", dirlen, filename, filename + dirlen);
+	return path;
+}
+
+
+void editorJournalHeader(struct journalHead *h, struct stat *st){
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, "MINOCHJ1", 8);
+	h->size = st->st_size;
+	h->ino = st->st_ino;
+	h->mtime = st->st_mtim.tv_sec;
+	h->mtime_ns = st->st_mtim.tv_nsec;
+}
+
+
+int editorJournalCreate(){						// (iolock held) the first batch since the journal started over
+	struct journal *J = &E.journal;
+	int fd = open(J->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if(fd == -1) return -1;
+	if(flock(fd, LOCK_EX | LOCK_NB) == -1){				// another minoch has it
+		close(fd);
+		return -1;
+	}
+	struct journalHead h;
+	editorJournalHeader(&h, &J->base);
+	if(ftruncate(fd, 0) == -1 || write(fd, &h, sizeof(h)) != sizeof(h)){
+		close(fd);
+		return -1;
+	}
+	J->fd = fd;
+	char *dir = strdup(J->path);					// the journal itself has to survive a crash
+	int dfd = open(dirname(dir), O_RDONLY);
+	if(dfd != -1){
+		fsync(dfd);
+		close(dfd);
+	}
+	free(dir);
+	return 0;
+}
+
+
+void *editorJournalMain(void *arg){					// the journal thread : write the records, a batch at a time
+	struct journal *J = &E.journal;
+	(void)arg;
+	pthread_mutex_lock(&J->lock);
+	while(1){
+		while(J->len == 0) pthread_cond_wait(&J->wake, &J->lock);
+		struct timespec t;						// let the records of the next few keys pile up
+		clock_gettime(CLOCK_REALTIME, &t);
+		t.tv_nsec += MINOCH_JOURNAL_MS * 1000000L;
+		t.tv_sec += t.tv_nsec / 1000000000L;
+		t.tv_nsec %= 1000000000L;
+		while(pthread_cond_timedwait(&J->wake, &J->lock, &t) != ETIMEDOUT);
+		char *batch = J->buf;						// swap the buffers, the editor goes on with an empty one
+		size_t n = J->len, cap = J->cap;
+		J->buf = J->out;
+		J->cap = J->outcap;
+		J->out = batch;
+		J->outcap = cap;
+		J->len = 0;
+		J->last = (size_t)-1;
+		unsigned gen = J->gen;
+		pthread_mutex_unlock(&J->lock);
+
+		pthread_mutex_lock(&J->iolock);
+		if(gen == J->gen){						// else the file was saved meanwhile, these edits are in it
+			const char *p = batch;
+			if(J->fd == -1 && editorJournalCreate() == -1) J->error = errno ? errno : EWOULDBLOCK;
+			while(J->fd != -1 && n > 0){
+				ssize_t w = write(J->fd, p, n);
+				if(w == -1){
+					if(errno == EINTR) continue;
+					J->error = errno;
+					break;
+				}
+				p += w;
+				n -= w;
+			}
+			if(J->fd != -1 && fdatasync(J->fd) == -1) J->error = errno;
+		}
+		pthread_mutex_unlock(&J->iolock);
+		pthread_mutex_lock(&J->lock);
+	}
+	return NULL;
+}
+
+
+struct journalRec *editorJournalAdd(int type, int r, int c, int er, int ec, const char *s, int len){	// (lock held) a new record
+	struct journal *J = &E.journal;
+	size_t need = sizeof(struct journalRec) + len;
+	if(J->len + need > J->cap){
+		size_t cap = J->cap ? J->cap : 4096;
+		while(cap < J->len + need) cap *= 2;
+		char *buf = realloc(J->buf, cap);
+		if(buf == NULL) die("realloc");
+		J->buf = buf;
+		J->cap = cap;
+	}
+	struct journalRec rec = { 0, len, type, r, c, er, ec };
+	J->last = J->len;
+	J->lhash = editorJournalHash(editorJournalHash(2166136261u, &rec.type, sizeof(rec) - offsetof(struct journalRec, type)), s, len);
+	rec.hash = J->lhash;
+	memcpy(J->buf + J->len, &rec, sizeof(rec));
+	memcpy(J->buf + J->len + sizeof(rec), s, len);
+	if(J->len == 0) pthread_cond_signal(&J->wake);
+	J->len += need;
+	return (struct journalRec *)(J->buf + J->last);
+}
+
+
+
+
+
+void editorJournalInsert(int r, int c, const char *s, int len){
+	struct journal *J = &E.journal;
+	if(J->path == NULL) return;
+	pthread_mutex_lock(&J->lock);
+	struct journalRec head;
+	if(J->last != (size_t)-1) memcpy(&head, J->buf + J->last, sizeof(head));
+	if(J->last != (size_t)-1 && head.type == UNDO_INSERT && J->lrow == r && J->lcol == c && memchr(s, '\n', len) == NULL
+		&& J->last + sizeof(head) + head.len == J->len && J->len + len <= J->cap && head.len < MINOCH_UNDO_COALESCE){
+		memcpy(J->buf + J->len, s, len);				// typing right after the last insert : it goes in the same record
+		J->len += len;
+		head.len += len;
+		J->lhash = editorJournalHash(J->lhash, s, len);
+		head.hash = J->lhash;
+		memcpy(J->buf + J->last, &head, sizeof(head));
+	}else{
+		editorJournalAdd(UNDO_INSERT, r, c, 0, 0, s, len);
+	}
+	J->lrow = r;
+	J->lcol = c + len;
+	if(memchr(s, '\n', len)) J->lrow = -1;				// not worth finding where it ends : no merge
+	pthread_mutex_unlock(&J->lock);
+	editorJournalKick();
+}
+
+
+void editorJournalDelete(int r, int c, int er, int ec){
+	struct journal *J = &E.journal;
+	if(J->path == NULL) return;
+	pthread_mutex_lock(&J->lock);
+	editorJournalAdd(UNDO_DELETE, r, c, er, ec, "", 0);
+	J->lrow = -1;
+	pthread_mutex_unlock(&J->lock);
+	editorJournalKick();
+}
+
+
+void editorJournalReplace(const char *text, int len, int flen, int tlen){	// a replace-all is one record, like in the undo log
+	struct journal *J = &E.journal;
+	const int *m = (const int *)text;
+	if(J->path == NULL) return;
+	pthread_mutex_lock(&J->lock);
+	editorJournalAdd(UNDO_REPLACE, m[0], m[1], flen, tlen, text, len);
+	J->lrow = -1;
+	pthread_mutex_unlock(&J->lock);
+	editorJournalKick();
+}
+
+
+void editorJournalStop(int remove){					// no more journaling : drop what is pending (and the file)
+	struct journal *J = &E.journal;
+	pthread_mutex_lock(&J->iolock);
+	pthread_mutex_lock(&J->lock);
+	J->len = 0;
+	J->last = (size_t)-1;
+	J->gen++;
+	pthread_mutex_unlock(&J->lock);
+	if(J->fd != -1){
+		if(remove) unlink(J->path);
+		close(J->fd);
+		J->fd = -1;
+	}
+	free(J->path);
+	J->path = NULL;
+	J->error = 0;
+	pthread_mutex_unlock(&J->iolock);
+}
+
+
+void editorJournalKick(){						// after adding records : the thread runs, and we tell if it failed
+	struct journal *J = &E.journal;
+	if(!J->started){
+		J->started = 1;
+		if(pthread_create(&J->thread, NULL, editorJournalMain, NULL) != 0) die("pthread_create");
+	}
+	if(J->error){
+		editorSetStatusMessage("Journal : %s, edits are not journaled anymore", strerror(J->error));
+		editorJournalStop(0);
+	}
+}
+
+
+void editorJournalReset(){						// the file has every edit now (just opened or saved) : the journal starts over
+	struct journal *J = &E.journal;
+	editorJournalStop(1);
+	if(E.filename == NULL || stat(E.filename, &J->base) == -1) return;
+	J->path = editorJournalPath(E.filename);			// the file itself is created with the first batch
+}
+
+
+void editorJournalClose(){						// normal exit
+	editorJournalStop(1);
+}
+
+
+int editorJournalReplay(char *p, size_t n){				// apply the records of a journal, returns how many bytes were good
+	char *start = p, *end = p + n;
+	struct journalRec rec;
+	int count = 0;
+	editorUndoBeginGroup();
+	while(end - p >= (long)sizeof(rec)){
+		memcpy(&rec, p, sizeof(rec));
+		if(rec.len > (size_t)(end - p) - sizeof(rec)) break;	// torn
+		char *text = p + sizeof(rec);
+		uint32_t h = editorJournalHash(editorJournalHash(2166136261u, &rec.type, sizeof(rec) - offsetof(struct journalRec, type)), text, rec.len);
+		if(h != rec.hash || rec.row < 0 || rec.col < 0 || rec.row > E.numrows
+			|| (rec.row < E.numrows && rec.col > editorRowAt(rec.row)->size)) break;
+		if(rec.type == UNDO_INSERT){
+			int er, ec;
+			editorUndoInsert(rec.row, rec.col, text, rec.len);
+			editorInsertText(rec.row, rec.col, text, rec.len, &er, &ec);
+			E.cy = er;
+			E.cx = ec;
+		}else if(rec.type == UNDO_REPLACE){
+			if(!editorReplaceReplay(text, rec.len, rec.erow, rec.ecol)) break;
+		}else{
+			if(rec.erow < rec.row || rec.erow >= E.numrows || rec.col > editorRowAt(rec.row)->size
+				|| rec.ecol > editorRowAt(rec.erow)->size || (rec.erow == rec.row && rec.ecol < rec.col)) break;
+			int len;
+			char *text = editorCopyText(rec.row, rec.col, rec.erow, rec.ecol, &len);
+			editorUndoDelete(rec.row, rec.col, rec.erow, rec.ecol, text, len);
+			free(text);
+			editorDeleteText(rec.row, rec.col, rec.erow, rec.ecol);
+			E.cy = rec.row;
+			E.cx = rec.col;
+		}
+		p += sizeof(rec) + rec.len;
+		count++;
+	}
+	editorUndoEndGroup();
+	if(count){
+		const char *name = strrchr(E.filename, '/');
+		editorSetStatusMessage("Recovered %d edits from the journal of %.30s, Ctrl-Z undoes them", count, name ? name + 1 : E.filename);
+	}
+	return p - start;
+}
+
+
+void editorJournalOpen(){						// after opening a file : replay the journal a crashed session left
+	struct journal *J = &E.journal;
+	editorJournalReset();
+	if(J->path == NULL) return;
+	int fd = open(J->path, O_RDWR | O_CLOEXEC);
+	if(fd == -1) return;						// no journal, the usual case
+	if(flock(fd, LOCK_EX | LOCK_NB) == -1){
+		editorSetStatusMessage("Another minoch is editing this file, edits are not journaled");
+		close(fd);
+		free(J->path);
+		J->path = NULL;
+		return;
+	}
+	struct stat st;
+	struct journalHead h, cur;
+	editorJournalHeader(&cur, &J->base);
+	char *data = NULL;
+	if(fstat(fd, &st) == -1 || read(fd, &h, sizeof(h)) != sizeof(h) || memcmp(&h, &cur, sizeof(h)) != 0){
+		editorSetStatusMessage("The journal is older than the file, not replayed");
+		close(fd);						// the next edit starts it over
+		return;
+	}
+	size_t n = st.st_size - sizeof(h);
+	data = malloc(n + 1);
+	if(data == NULL) die("malloc");
+	if(read(fd, data, n) != (ssize_t)n){
+		free(data);
+		close(fd);
+		return;
+	}
+	char *path = J->path;
+	J->path = NULL;							// what we replay is in the journal already
+	size_t good = editorJournalReplay(data, n);
+	J->path = path;
+	free(data);
+	if(ftruncate(fd, sizeof(h) + good) == -1 || lseek(fd, 0, SEEK_END) == -1){	// a torn last record goes, we append after the good ones
+		close(fd);
+		return;
+	}
+	J->fd = fd;
+}
+
+
+
+
+/*** File i/o ***/
+
+void editorUnmapFile(){						// drop the mapping of the opened file, rows must not point in it anymore 
+	if(E.mapfd != -1) close(E.mapfd);
+	E.mapfd = -1;
+	if(E.map == NULL) return;
+	munmap(E.map, E.mapsize);
+	E.map = NULL;
+	E.mapsize = 0;
+}
+
+
+/* parallel loading : the map is cut in chunks and the workers of the pool go through them twice. the first pass counts the
+ newlines of every chunk (16 or 32 bytes per step) and remembers its last one, so we know which row each chunk starts with and
+ where that row begins; the second pass writes the rows of each chunk straight to their place in E.row. both passes only
+ read the map and write their own rows, so no lock is needed. */
+
+size_t editorCountNewlinesScalar(const char *p, size_t n){
+	const char *end = p + n;
+	size_t count = 0;
+	while((p = memchr(p, '\n', end - p)) != NULL){
+		count++;
+		p++;
+	}
+	return count;
+}
+
+
+#if defined(__SSE2__)
+size_t editorCountNewlinesSSE2(const char *p, size_t n){
+	__m128i nl = _mm_set1_epi8('\n');
+	size_t i = 0, count = 0;
+	for(; i + 16 <= n; i += 16)
+		count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl)));
+	return count + editorCountNewlinesScalar(p + i, n - i);
+}
+#endif
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,popcnt")))
+size_t editorCountNewlinesAVX2(const char *p, size_t n){
+	__m256i nl = _mm256_set1_epi8('\n');
+	size_t i = 0, count = 0;
+	for(; i + 64 <= n; i += 64){					// two loads per step, the loop is bound by the loads
+		unsigned a = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+		unsigned b = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i + 32)), nl));
+		count += __builtin_popcount(a) + __builtin_popcount(b);
+	}
+	return count + editorCountNewlinesScalar(p + i, n - i);
+}
+#endif
+
+
+size_t editorCountNewlines(const char *p, size_t n){
+#if defined(__x86_64__) || defined(__i386__)
+	static int avx2 = -1;
+	if(avx2 == -1) avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+	if(avx2) return editorCountNewlinesAVX2(p, n);
+#endif
+#if defined(__SSE2__)
+	return editorCountNewlinesSSE2(p, n);
+#else
+	return editorCountNewlinesScalar(p, n);
+#endif
+}
+
+
+void editorLoadJob(int id){
+	struct loadState *L = &E.load;
+	int c;
+	(void)id;
+	while((c = __atomic_fetch_add(&L->next, 1, __ATOMIC_RELAXED)) < L->nchunks){
+		struct loadChunk *ch = &L->chunks[c];
+		off_t base = (off_t)c * MINOCH_LOAD_CHUNK;
+		size_t n = E.mapsize - base < MINOCH_LOAD_CHUNK ? E.mapsize - base : MINOCH_LOAD_CHUNK;
+		const char *p = E.map + base, *end = p + n;
+		if(L->pass == 0){
+			ch->nl = editorCountNewlines(p, n);
+			const char *last = ch->nl ? memrchr(p, '\n', n) : NULL;
+			ch->last = last ? last - E.map : -1;
+			continue;
+		}
+		erow *row = &E.row[E.numrows + ch->row];
+		unsigned long long version = L->version + ch->row;
+		off_t start = ch->start;
+		while((p = memchr(p, '\n', end - p)) != NULL){
+			const char *s = E.map + start, *eol = p;
+			while(eol > s && eol[-1] == '\r') eol--;	// same trimming as the getline loop did
+			row->size = eol - s;
+			row->rslot = -1;
+			row->chars = NULL;
+			row->foff = start;
+			row->version = ++version;
+			row->hl_ok = 0;
+			row++;
+			start = ++p - E.map;
+		}
+	}
+}
+
+
+void editorLoadPass(int pass){
+	E.load.pass = pass;
+	E.load.next = 0;
+	if(E.load.nchunks == 1){					// not worth waking the threads up
+		editorLoadJob(0);
+		return;
+	}
+	editorPoolStart(editorLoadJob);
+	editorPoolWait();
+}
+
+
+void editorLoadRows(){								// index the rows of E.map
+	struct loadState *L = &E.load;
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	L->nchunks = (E.mapsize + MINOCH_LOAD_CHUNK - 1) / MINOCH_LOAD_CHUNK;
+	L->chunks = malloc(sizeof(struct loadChunk) * L->nchunks);
+	if(L->chunks == NULL) die("malloc");
+	editorLoadPass(0);
+
+	long rows = 0;
+	off_t last = -1;
+	int c;
+	for(c = 0; c < L->nchunks; c++){					// stitch : where each chunk's rows go and where its first one starts
+		L->chunks[c].row = rows;
+		L->chunks[c].start = last + 1;
+		rows += L->chunks[c].nl;
+		if(L->chunks[c].last >= 0) last = L->chunks[c].last;
+	}
+	editorRowReserve(rows + 1);
+	editorRowMoveGap(E.numrows);
+	L->version = E.rowversion;
+	editorLoadPass(1);
+	E.numrows += rows;
+	E.gap += rows;
+	E.rowversion += rows;
+	editorWrapRebuild();
+	if(last + 1 < (off_t)E.mapsize){					// the last line has no newline
+		const char *s = E.map + last + 1, *eol = E.map + E.mapsize;
+		while(eol > s && eol[-1] == '\r') eol--;
+		editorAppendMappedRow(last + 1, eol - s);
+	}
+	free(L->chunks);
+	L->chunks = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	if(L->nchunks > 1)
+		editorSetStatusMessage("%d lines, %.1f MB loaded in %.3fs (%.0f MB/s, %d threads)", E.numrows,
+			E.mapsize / 1048576.0, secs, E.mapsize / 1048576.0 / (secs > 0 ? secs : 1e-9), E.pool.nthreads);
+}
+
+
+int editorOpenMapped(char *filename){			// map the file and only index where its lines start; returns -1 if it can't be mapped
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1) die("open");
+	struct stat st;
+	if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)){	// pipes, /proc files & co have no real size, we read them the old way
+		close(fd);
+		return -1;
+	}
+	if(st.st_size == 0){
+		close(fd);
+		return 0;
+	}
+	char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED){
+		close(fd);
+		return -1;
+	}
+	E.mapfd = fd;							// the file stays open for editorWriteRows, whatever happens to its name
+	madvise(map, st.st_size, MADV_SEQUENTIAL);		// we are about to read it once from start to end
+	E.map = map;
+	E.mapsize = st.st_size;
+
+	editorLoadRows();
+	madvise(map, st.st_size, MADV_RANDOM);			// from now on we only touch the rows we show or edit
+	return 0;
+}
+
+
+void editorOpen(char *filename) {			// function to open files, we read line by line from the file we want to open !
+
+free(E.filename);
+E.filename = strdup(filename);  				//get filename and store it ! strdup from string.h makes a copy of its argument
+editorSelectSyntaxHighlight();
+
+if(editorOpenMapped(filename) == 0){			// regular files are mmap'ed, rows get rendered when shown and copied only when edited
+  E.dirty = 0;
+  editorJournalOpen();
+  return;
+}
+
+FILE *fp = fopen(filename, "r");
+  if(!fp) die("fopen");
+
+  char *line = NULL;
+  size_t linecap = 0;
+  ssize_t linelen;
+  while ((linelen = getline(&line, &linecap, fp)) != -1) {
+    while (linelen > 0 && (line[linelen - 1] == '\n' ||
+	                   line[linelen - 1] == '\r'))
+      linelen--;
+    
+    editorInsertRow(E.numrows, line, linelen);
+  }
+  free(line);
+  fclose(fp);
+  E.dirty = 0;
+  editorJournalOpen();
+}
+
+
+
+int editorWriteAll(int fd, struct iovec *iov, int iovcnt){	// writev until everything went out (writev may stop in the middle)
+	while(iovcnt > 0){
+		ssize_t n = writev(fd, iov, iovcnt);
+		if(n == -1){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		while(iovcnt > 0 && (size_t)n >= iov->iov_len){	// drop what was fully written
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0){						// and skip the written part of the one that was cut
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+
+/* rows that were never edited still lie in the opened file the way we would write them, one after the other with a '\n' each.
+ such a run of rows is one piece of the old file : a long one is copied by the kernel (copy_file_range, which clones the
+ blocks on filesystems that can share them), a short one goes out as a single iovec. only the edited rows really go through
+ writev, so fixing a line in a big file mostly costs the copy the kernel does, not reading and writing it all ourselves. */
+
+int editorCloneRange(int fd, off_t off, size_t len, int *clone, size_t *cloned){	// copy len bytes at off of the old file to fd
+	while(*clone && len > 0){
+		ssize_t n = copy_file_range(E.mapfd, &off, fd, NULL, len, 0);
+		if(n == -1 && errno == EINTR) continue;
+		if(n <= 0){							// not between these two files (other filesystem, old kernel ...) :
+			*clone = 0;						// the rest is written from the map
+			break;
+		}
+		len -= n;
+		*cloned += n;
+	}
+	if(len == 0) return 0;
+	struct iovec iov = { E.map + off, len };
+	return editorWriteAll(fd, &iov, 1);
+}
+
+
+int editorWriteRows(int fd, size_t *written, size_t *cloned){	// stream all the rows to fd, MINOCH_SAVE_BATCH pieces per syscall, no copy of the text
+	struct iovec iov[MINOCH_SAVE_BATCH * 2];
+	int n = 0;
+	int j;
+	int clone = E.mapfd != -1;
+	off_t run = -1, runend = 0;					// [run, runend) : unedited rows of the old file, as they are
+	*written = *cloned = 0;
+	for(j = 0; j <= E.numrows; j++){
+		if(n >= MINOCH_SAVE_BATCH * 2 - 3){				// a row adds 3 iovecs at most (the run before it, its text, '\n')
+			if(editorWriteAll(fd, iov, n) == -1) return -1;
+			n = 0;
+		}
+		erow *row = j < E.numrows ? editorRowAt(j) : NULL;
+		off_t end = row ? row->foff + row->size : 0;
+		int asis = row && row->chars == NULL && end < (off_t)E.mapsize && E.map[end] == '\n';
+		if(asis && run != -1 && row->foff == runend){
+			runend = end + 1;
+			*written += row->size + 1;
+			continue;
+		}
+		if(run != -1){							// the run is over : send it
+			if(runend - run >= MINOCH_SAVE_CLONE && clone){
+				if(editorWriteAll(fd, iov, n) == -1 || editorCloneRange(fd, run, runend - run, &clone, cloned) == -1) return -1;
+				n = 0;
+			}else{
+				iov[n].iov_base = E.map + run;
+				iov[n].iov_len = runend - run;
+				n++;
+			}
+			run = -1;
+		}
+		if(row == NULL) break;
+		*written += row->size + 1;
+		if(asis){
+			run = row->foff;
+			runend = end + 1;
+			continue;
+		}
+		if(row->size){
+			iov[n].iov_base = editorRowData(row);		// edited, or from the map (a line that ended with \r\n, the last one ...)
+			iov[n].iov_len = row->size;
+			n++;
+		}
+		iov[n].iov_base = "\n";
+		iov[n].iov_len = 1;
+		n++;
+	}
+	return editorWriteAll(fd, iov, n);
+}
+
+
+void editorRemapSaved(const char *path, size_t len){		// the rows are in the file we just wrote, len bytes, one '\n' after each :
+	int fd = open(path, O_RDONLY | O_CLOEXEC);			// map it instead of the old one (which is gone from the directory),
+	struct stat st;							// the unedited rows point in it at their new place. nothing is read
+	if(fd == -1 || fstat(fd, &st) == -1 || st.st_size != (off_t)len){	// again, the undo history stays
+		if(fd != -1) close(fd);					// (changed under us already : keep the old map, still good)
+		return;
+	}
+	char *map = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	if(map == MAP_FAILED){
+		close(fd);
+		return;
+	}
+	off_t off = 0;
+	int j;
+	for(j = 0; j < E.numrows; j++){
+		erow *row = editorRowAt(j);
+		if(row->chars == NULL) row->foff = off;
+		off += row->size + 1;
+	}
+	editorUnmapFile();
+	if(map){
+		E.map = map;
+		E.mapsize = len;
+		E.mapfd = fd;
+	}else{
+		close(fd);
+	}
+	if(E.follow.on){						// follow the new file, from its end
+		editorFollowStop();
+		if(editorFollowWatch() == -1){
+			editorSetStatusMessage("Can't follow %s anymore", E.filename);
+			free(E.follow.name);
+			E.follow.name = NULL;
+			return;
+		}
+		E.follow.on = 1;
+		E.follow.size = E.mapsize;
+	}
+}
+
+
+void editorSave(){
+	if(E.filename == NULL){
+		E.filename = editorPrompt("Save as : %s (ESC to cancel)", NULL);
+		if(E.filename == NULL){
+			editorSetStatusMessage("Save Canceled");
+			return;
+		}
+		editorSelectSyntaxHighlight();
+	}
+
+	// we never write in the file itself : the rows go to a temp file next to it, which is fsync'ed then renamed over the original.
+	// a crash in the middle leaves the old file untouched, and the old file stays valid under our mapping since rename doesn't change it.
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	char *target = realpath(E.filename, NULL);			// if the file is a symlink we replace what it points to, not the link
+	if(target == NULL) target = strdup(E.filename);
+	char *tmpname = target ? malloc(strlen(target) + 16) : NULL;
+	size_t len = 0, cloned = 0;
+	if(tmpname == NULL){
+		errno = ENOMEM;
+		goto fail;
+	}
+	sprintf(tmpname, "%s.minoch-XXXXXX", target);
+
+	int fd = mkstemp(tmpname);
+	if(fd == -1) goto fail;
+
+	struct stat st;
+	if(stat(target, &st) == 0){					// keep the permissions of the file we replace
+		fchmod(fd, st.st_mode & 07777);
+	}else{								// new file : 0644 minus the umask, like open(O_CREAT, 0644) did
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0644 & ~mask);
+	}
+
+	if(editorWriteRows(fd, &len, &cloned) == -1 || fsync(fd) == -1){
+		int saved = errno;
+		close(fd);
+		unlink(tmpname);
+		errno = saved;
+		goto fail;
+	}
+	close(fd);
+	if(rename(tmpname, target) == -1){
+		int saved = errno;
+		unlink(tmpname);
+		errno = saved;
+		goto fail;
+	}
+	int dfd = open(dirname(tmpname), O_RDONLY);			// make the rename itself durable (dirname may modify tmpname, we're done with it)
+	if(dfd != -1){
+		fsync(dfd);
+		close(dfd);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	E.dirty = 0;
+	editorJournalReset();						// every edit is in the file now
+	editorRemapSaved(target, len);
+	editorSetStatusMessage("%zu bytes written in %.3fs (%zu MB cloned), peak RSS %ld MB", len,
+		(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, cloned >> 20, ru.ru_maxrss / 1024);
+	free(tmpname);
+	free(target);
+	return;
+
+fail:
+	editorSetStatusMessage("Error while saving : %s",  strerror(errno));				//strerror from string.h takes errno global as argument and prints human readable message error
+	free(tmpname);
+	free(target);
+}
+
+
+
+
+/**** Follow mode ****/
+
+/* Ctrl-T (or minoch -f file) follows a growing file, like tail -F. inotify tells us when the file or its directory changes,
+ we then fstat the file we have open : if it grew, the map is extended with mremap and only the new bytes are cut in rows,
+ so the work is the size of what was appended. if it shrank (truncated) or the name now points to another file (rotated),
+ the file is opened again. updates are done at most once per MINOCH_FOLLOW_MS, a log written in small pieces is read in
+ batches. the cursor on the last row stays on the last row, anywhere else it stays where it is. */
+
+void editorFollowStop(){
+	struct followState *F = &E.follow;
+	if(!F->on) return;
+	close(F->ifd);
+	close(F->fd);
+	free(F->name);
+	F->name = NULL;
+	F->on = 0;
+}
+
+
+int editorFollowWatch(){						// open the file and watch it; -1 if it can't be followed
+	struct followState *F = &E.follow;
+	struct stat st;
+	F->fd = open(E.filename, O_RDONLY | O_CLOEXEC);
+	if(F->fd == -1) return -1;
+	if(fstat(F->fd, &st) == -1 || !S_ISREG(st.st_mode)){
+		close(F->fd);
+		return -1;
+	}
+	char *dir = strdup(E.filename);
+	char *slash = strrchr(dir, '/');
+	free(F->name);
+	F->name = strdup(slash ? slash + 1 : dir);
+	if(slash) slash[slash == dir] = '\0';				// "/x" lives in "/"
+	F->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	int ok = F->ifd != -1 && inotify_add_watch(F->ifd, E.filename, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) != -1
+		&& inotify_add_watch(F->ifd, slash ? dir : ".", IN_CREATE | IN_MOVED_TO) != -1;
+	free(dir);
+	if(!ok){
+		if(F->ifd != -1) close(F->ifd);
+		close(F->fd);
+		return -1;
+	}
+	F->missing = 0;
+	F->next = 0;
+	return 0;
+}
+
+
+void editorFollowReload(const char *why){				// the rows have to come from the file again (truncated, rotated)
+	struct followState *F = &E.follow;
+	int pinned = E.cy >= E.numrows - 1;
+	editorSearchStop();
+	if(!editorRowsClose()) editorSetStatusMessage("row memory accounting is off, something leaked");
+	editorUnmapFile();
+	editorUndoFreeChunks(E.undo.head);				// the history talks about rows that are gone
+	free(E.undo.recs);
+	memset(&E.undo, 0, sizeof(E.undo));
+	E.hl_clean = E.hl_high = 0;
+	E.hl_dirty_hi = -1;
+	close(F->ifd);
+	close(F->fd);
+	F->on = 0;
+	if(editorOpenMapped(E.filename) == -1 || editorFollowWatch() == -1){
+		editorSetStatusMessage("Can't follow %s anymore", E.filename);
+		free(F->name);
+		F->name = NULL;
+		return;
+	}
+	F->on = 1;
+	F->size = E.mapsize;
+	E.dirty = 0;
+	editorJournalReset();
+	if(pinned || E.cy >= E.numrows) E.cy = E.numrows > 0 ? E.numrows - 1 : 0;
+	E.cx = 0;
+	E.rowoff = 0;							// editorScroll brings the cursor back in view from the top
+	if(why) editorSetStatusMessage("%.40s %s", E.filename, why);
+}
+
+
+void editorFollowAppend(off_t size){					// the file grew from F->size to size : make rows of the new bytes only
+	struct followState *F = &E.follow;
+	off_t p = F->size;
+	int pinned = E.cy >= E.numrows - 1;
+	char *map = E.map ? mremap(E.map, E.mapsize, size, MREMAP_MAYMOVE) : mmap(NULL, size, PROT_READ, MAP_PRIVATE, F->fd, 0);
+	if(map == MAP_FAILED){
+		editorSetStatusMessage("Follow stopped, can't map %s : %s", E.filename, strerror(errno));
+		editorFollowStop();
+		return;
+	}
+	if(E.map == NULL) E.mapfd = dup(F->fd);
+	E.map = map;							// rows keep offsets, the map moving is fine
+	E.mapsize = size;
+	int at = E.numrows;
+	if(p > 0 && E.map[p - 1] != '\n' && E.numrows > 0){		// the last line was not over : it goes on with the new bytes
+		erow *row = editorRowAt(E.numrows - 1);
+		const char *nl = memchr(E.map + p, '\n', size - p);
+		const char *eol = nl ? nl : E.map + size;
+		while(eol > E.map + p && eol[-1] == '\r') eol--;
+		if(row->chars == NULL){
+			if(eol > E.map + p) row->size = eol - (E.map + row->foff);
+		}else{								// edited : the new text goes at the end of what is there
+			int dirty = E.dirty;
+			const char *from = E.map + p;
+			while(from > E.map && from[-1] == '\r') from--;		// a \r we cut is in the middle of the line after all
+			if(eol > from) editorRowAppendString(row, (char *)from, eol - from);
+			E.dirty = dirty;
+		}
+		editorUpdateRow(row);
+		p = nl ? nl - E.map + 1 : size;
+	}
+	editorRowReserve(editorCountNewlines(E.map + p, size - p) + 1);
+	while(p < size){
+		const char *s = E.map + p;
+		const char *nl = memchr(s, '\n', size - p);
+		const char *eol = nl ? nl : E.map + size;
+		p = nl ? nl - E.map + 1 : size;
+		while(eol > s && eol[-1] == '\r') eol--;
+		editorAppendMappedRow(s - E.map, eol - s);
+	}
+	editorSearchRowsAppended(at, E.numrows - at);
+	editorSyntaxRowChanged(at);
+	F->size = size;
+	if(pinned && E.numrows > 0 && E.cy != E.numrows - 1){
+		E.cy = E.numrows - 1;
+		E.cx = 0;
+	}
+}
+
+
+int editorFollowCheck(){						// look at the file now; 1 if the rows changed
+	struct followState *F = &E.follow;
+	struct stat st, cur;
+	if(stat(E.filename, &st) == -1){				// rotated away : we keep what the old file gets until a new one comes
+		if(!F->missing) editorSetStatusMessage("%s is gone, waiting for it to come back", E.filename);
+		F->missing = 1;
+	}else if(fstat(F->fd, &cur) == 0 && (st.st_ino != cur.st_ino || st.st_dev != cur.st_dev)){
+		F->missing = 0;
+		if(E.dirty){
+			editorSetStatusMessage("%s was replaced, follow stopped to keep your changes", E.filename);
+			editorFollowStop();
+			return 1;
+		}
+		editorFollowReload("was replaced, reloaded");
+		return 1;
+	}else{
+		F->missing = 0;
+	}
+	if(fstat(F->fd, &cur) == -1) return 0;
+	if(cur.st_size < F->size){					// truncated : the rows past the new end are gone from the map too
+		editorFollowReload(E.dirty ? "was truncated, unsaved changes are lost" : "was truncated, reloaded");
+		return 1;
+	}
+	if(cur.st_size > F->size){
+		editorFollowAppend(cur.st_size);
+		return 1;
+	}
+	return 0;
+}
+
+
+int editorFollowUpdate(){						// inotify woke us up (E.rowlock is free); 1 if the screen needs a redraw
+	struct followState *F = &E.follow;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while(read(F->ifd, buf, sizeof(buf)) > 0);			// which event it was doesn't matter, fstat tells us what changed
+	F->next = editorPerfNow() + MINOCH_FOLLOW_MS * 1000000ULL;
+	pthread_rwlock_wrlock(&E.rowlock);
+	int changed = editorFollowCheck();
+	pthread_rwlock_unlock(&E.rowlock);
+	return changed;
+}
+
+
+void editorFollowToggle(){
+	if(E.follow.on){
+		editorFollowStop();
+		editorSetStatusMessage("Follow stopped");
+		return;
+	}
+	if(E.filename == NULL || editorFollowWatch() == -1){
+		editorSetStatusMessage("Only a regular file can be followed");
+		return;
+	}
+	struct stat st, cur;						// the rows must come from the file we watch : after a save (a new file
+	int other = E.mapfd != -1 ? fstat(E.mapfd, &st) == -1 || fstat(E.follow.fd, &cur) == -1	// renamed over the old one) or a
+		|| st.st_ino != cur.st_ino || st.st_dev != cur.st_dev : E.numrows > 0 && !E.dirty;	// rotation, growing the map would fault
+	E.follow.on = 1;
+	if(other && E.dirty){
+		editorFollowStop();
+		editorSetStatusMessage("%.40s changed on disk, save before following it", E.filename);
+		return;
+	}
+	if(other) editorFollowReload(NULL);
+	if(!E.follow.on) return;
+	E.follow.size = E.mapsize;
+	E.cy = E.numrows > 0 ? E.numrows - 1 : 0;
+	E.cx = 0;
+	editorFollowCheck();						// it may have changed since we opened it
+	if(E.follow.on) editorSetStatusMessage("Following %s, Ctrl-T to stop", E.filename);
+}
+
+
+
+
+/**** Search ****/
+
+/* substring kernel : we look for the first AND the last byte of the needle at once, 16 (SSE2) or 32 (AVX2) positions per step,
+ and only call memcmp where both match. AVX2 is picked at runtime when the cpu has it, other cpus get the plain C version. */
+
+const char *editorMemmemScalar(const char *hay, size_t n, const char *needle, size_t m){
+	const char *p = hay, *end = hay + n - m + 1;		// the needle can't start after end - 1
+	while(p < end && (p = memchr(p, needle[0], end - p)) != NULL){
+		if(p[m - 1] == needle[m - 1] && memcmp(p + 1, needle + 1, m > 2 ? m - 2 : 0) == 0)
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+
+#if defined(__SSE2__)
+const char *editorMemmemSSE2(const char *hay, size_t n, const char *needle, size_t m){
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+	for(; i + m - 1 + 16 <= n; i += 16){			// block_last reads up to hay[i + m - 1 + 15]
+		__m128i bf = _mm_loadu_si128((const __m128i *)(hay + i));
+		__m128i bl = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+		while(mask){
+			int bit = __builtin_ctz(mask);
+			if(m <= 2 || memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+				return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+	if(i + m > n) return NULL;
+	return editorMemmemScalar(hay + i, n - i, needle, m);	// what is left is less than one block
+}
+#endif
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+const char *editorMemmemAVX2(const char *hay, size_t n, const char *needle, size_t m){
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+	for(; i + m - 1 + 32 <= n; i += 32){
+		__m256i bf = _mm256_loadu_si256((const __m256i *)(hay + i));
+		__m256i bl = _mm256_loadu_si256((const __m256i *)(hay + i + m - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl)));
+		while(mask){
+			int bit = __builtin_ctz(mask);
+			if(m <= 2 || memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+				return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+	if(i + m > n) return NULL;
+	return editorMemmemScalar(hay + i, n - i, needle, m);
+}
+#endif
+
+
+const char *editorMemmem(const char *hay, size_t n, const char *needle, size_t m){	// first occurrence of needle in hay, or NULL
+	if(m == 0) return hay;
+	if(m > n) return NULL;
+	if(m == 1) return memchr(hay, needle[0], n);
+#if defined(__x86_64__) || defined(__i386__)
+	static int avx2 = -1;
+	if(avx2 == -1) avx2 = __builtin_cpu_supports("avx2");
+	if(avx2) return editorMemmemAVX2(hay, n, needle, m);
+#endif
+#if defined(__SSE2__)
+	return editorMemmemSSE2(hay, n, needle, m);
+#else
+	return editorMemmemScalar(hay, n, needle, m);
+#endif
+}
+
+
+
+/* background search : the rows are cut in blocks of MINOCH_SEARCH_BLOCK, the workers of the pool grab the blocks one after the
+ other (starting where the cursor is) and store each block's matches in it, so the results are always sorted by block then row.
+ the message bar counts the matches while they come, a new query cancels the workers right away.
+ the main thread edits rows only while it holds E.rowlock, so a block is never scanned while its rows change; when a row changes
+ we only fix the block it belongs to (and shift the next ones when rows are added or removed). */
+
+void editorMatchPush(struct searchBlock *b, int rel, int col){
+	if(b->n == b->cap){
+		b->cap = b->cap ? b->cap * 2 : 64;
+		b->m = realloc(b->m, sizeof(int) * 2 * b->cap);
+		if(b->m == NULL) die("realloc");
+	}
+	b->m[2 * b->n] = rel;
+	b->m[2 * b->n + 1] = col;
+	b->n++;
+}
+
+
+void editorSearchScanRow(struct searchBlock *b, int rel, erow *row, const char *q, int qlen){	// add all the matches of a row to b
+	const char *data = editorRowData(row);
+	int from = 0;
+	while(from <= row->size - qlen){
+		const char *p = editorMemmem(data + from, row->size - from, q, qlen);
+		if(p == NULL) break;
+		editorMatchPush(b, rel, p - data);
+		from = p - data + 1;
+	}
+}
+
+
+void editorSearchJob(int id){					// what every worker runs for a search
+	struct searchState *S = &E.search;
+	struct searchBlock acc = { 0 };				// matches of the block being scanned, handed to the block when it is done
+	(void)id;
+	while(!__atomic_load_n(&S->cancel, __ATOMIC_RELAXED)){
+		int k = __atomic_fetch_add(&S->next, 1, __ATOMIC_RELAXED);
+		if(k >= S->nblocks) break;
+		struct searchBlock *b = &S->blocks[(S->first + k) % S->nblocks];
+
+		pthread_rwlock_rdlock(&E.rowlock);
+		pthread_mutex_lock(&S->lock);
+		b->state = BLOCK_SCANNING;
+		pthread_mutex_unlock(&S->lock);
+		acc.n = 0;
+		int r;
+		for(r = b->start; r < b->end; r++){
+			if(__atomic_load_n(&S->cancel, __ATOMIC_RELAXED)) break;
+			editorSearchScanRow(&acc, r - b->start, editorRowAt(r), S->query, S->qlen);
+		}
+		pthread_mutex_lock(&S->lock);
+		if(r == b->end){					// swap buffers : the block gets the results, we reuse its (empty) array
+			struct searchBlock tmp = *b;
+			b->m = acc.m; b->n = acc.n; b->cap = acc.cap;
+			acc.m = tmp.m; acc.n = 0; acc.cap = tmp.cap;
+			b->state = BLOCK_DONE;
+			S->done++;
+			S->count += b->n;
+		}else{
+			b->state = BLOCK_PENDING;
+		}
+		pthread_cond_broadcast(&S->progress);
+		pthread_mutex_unlock(&S->lock);
+		uint64_t one = 1;
+		write(E.wakefd, &one, sizeof(one));			// the main thread may be asleep in poll()
+		pthread_rwlock_unlock(&E.rowlock);
+	}
+	free(acc.m);
+}
+
+
+void editorSearchStop(){					// cancel the workers and forget the results
+	struct searchState *S = &E.search;
+	if(S->query == NULL) return;
+	__atomic_store_n(&S->cancel, 1, __ATOMIC_RELAXED);
+	editorRowCloseGap();
+	pthread_rwlock_unlock(&E.rowlock);			// a worker waiting for the rows has to get them to see it is cancelled
+	editorPoolWait();
+	pthread_rwlock_wrlock(&E.rowlock);
+	int j;
+	for(j = 0; j < S->nblocks; j++) free(S->blocks[j].m);
+	free(S->blocks);
+	free(S->query);
+	S->blocks = NULL;
+	S->nblocks = 0;
+	S->query = NULL;
+	S->jump = 0;
+	E.match_len = 0;
+}
+
+
+void editorSearchStart(const char *query, int row){		// start scanning the whole file for query, beginning with the block of "row"
+	struct searchState *S = &E.search;
+	editorSearchStop();
+	S->query = strdup(query);
+	S->qlen = strlen(query);
+	S->nblocks = E.numrows ? (E.numrows + MINOCH_SEARCH_BLOCK - 1) / MINOCH_SEARCH_BLOCK : 1;
+	S->blocks = calloc(S->nblocks, sizeof(struct searchBlock));
+	if(S->blocks == NULL) die("calloc");
+	int j;
+	for(j = 0; j < S->nblocks; j++){
+		S->blocks[j].start = j * MINOCH_SEARCH_BLOCK;
+		S->blocks[j].end = (j + 1) * MINOCH_SEARCH_BLOCK < E.numrows ? (j + 1) * MINOCH_SEARCH_BLOCK : E.numrows;
+	}
+	S->first = row / MINOCH_SEARCH_BLOCK < S->nblocks ? row / MINOCH_SEARCH_BLOCK : 0;
+	S->next = 0;
+	S->cancel = 0;
+	S->done = S->shown_done = 0;
+	S->count = 0;
+	S->jump = 0;
+	editorPoolStart(editorSearchJob);
+}
+
+
+int editorSearchBlockOf(int row){				// the block a row belongs to : last block starting at or before it
+	struct searchState *S = &E.search;
+	int lo = 0, hi = S->nblocks - 1;
+	while(lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if(S->blocks[mid].start <= row) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+
+void editorSearchRowInserted(int at){				// a row was inserted at "at" : it belongs to its block now, the next rows moved down
+	struct searchState *S = &E.search;
+	if(S->query == NULL) return;
+	pthread_mutex_lock(&S->lock);
+	int bi = editorSearchBlockOf(at);
+	struct searchBlock *b = &S->blocks[bi];
+	int j;
+	for(j = 0; j < b->n; j++)
+		if(b->m[2 * j] >= at - b->start) b->m[2 * j]++;
+	b->end++;
+	for(j = bi + 1; j < S->nblocks; j++){
+		S->blocks[j].start++;
+		S->blocks[j].end++;
+	}
+	pthread_mutex_unlock(&S->lock);
+}
+
+
+void editorSearchRowsAppended(int at, int n){			// n rows were added at the end : they go in the last block, scanned now if it is done
+	struct searchState *S = &E.search;
+	if(S->query == NULL || S->nblocks == 0 || n <= 0) return;
+	pthread_mutex_lock(&S->lock);
+	struct searchBlock *b = &S->blocks[S->nblocks - 1];
+	b->end += n;
+	if(b->state == BLOCK_DONE){
+		int before = b->n, r;
+		for(r = at; r < at + n; r++) editorSearchScanRow(b, r - b->start, editorRowAt(r), S->query, S->qlen);
+		S->count += b->n - before;
+	}
+	pthread_mutex_unlock(&S->lock);
+}
+
+
+int editorSearchDropRow(struct searchBlock *b, int rel){	// remove the matches of a row from a block, returns where they were
+	int j = 0, k;
+	while(j < b->n && b->m[2 * j] < rel) j++;
+	k = j;
+	while(k < b->n && b->m[2 * k] == rel) k++;
+	memmove(&b->m[2 * j], &b->m[2 * k], sizeof(int) * 2 * (b->n - k));
+	b->n -= k - j;
+	E.search.count -= k - j;
+	return j;
+}
+
+
+void editorSearchRowDeleted(int at){
+	struct searchState *S = &E.search;
+	if(S->query == NULL) return;
+	pthread_mutex_lock(&S->lock);
+	int bi = editorSearchBlockOf(at);
+	struct searchBlock *b = &S->blocks[bi];
+	int j = editorSearchDropRow(b, at - b->start);
+	for(; j < b->n; j++) b->m[2 * j]--;
+	b->end--;
+	for(j = bi + 1; j < S->nblocks; j++){
+		S->blocks[j].start--;
+		S->blocks[j].end--;
+	}
+	pthread_mutex_unlock(&S->lock);
+}
+
+
+void editorSearchRowChanged(int at){				// the text of a row changed : rescan it if its block was already done
+	static struct searchBlock tmp;				// (a pending block will be scanned with the new text anyway)
+	struct searchState *S = &E.search;
+	if(S->query == NULL || at < 0 || at >= E.numrows) return;
+	pthread_mutex_lock(&S->lock);
+	int bi = editorSearchBlockOf(at);
+	struct searchBlock *b = &S->blocks[bi];
+	if(b->state == BLOCK_DONE){
+		int rel = at - b->start;
+		int j = editorSearchDropRow(b, rel);
+		tmp.n = 0;
+		editorSearchScanRow(&tmp, rel, editorRowAt(at), S->query, S->qlen);
+		while(b->n + tmp.n > b->cap){
+			b->cap = b->cap ? b->cap * 2 : 64;
+			b->m = realloc(b->m, sizeof(int) * 2 * b->cap);
+			if(b->m == NULL) die("realloc");
+		}
+		memmove(&b->m[2 * (j + tmp.n)], &b->m[2 * j], sizeof(int) * 2 * (b->n - j));
+		memcpy(&b->m[2 * j], tmp.m, sizeof(int) * 2 * tmp.n);
+		b->n += tmp.n;
+		S->count += tmp.n;
+	}
+	pthread_mutex_unlock(&S->lock);
+}
+
+
+/* look in the results for the match the pending jump waits for. returns 0 as long as a block on the way is not scanned yet,
+ 1 once we know (found tells if there is a match at all). must be called with the search lock held */
+int editorSearchResolve(int *found, int *outrow, int *outcol){
+	struct searchState *S = &E.search;
+	int n = S->nblocks, dir = S->jump;
+	int b0 = editorSearchBlockOf(S->jrow);
+	int k, i;
+	*found = 0;
+	for(k = 0; k <= n; k++){				// n + 1 : we come back to the first block for the part before the origin
+		struct searchBlock *b = &S->blocks[dir == 1 ? (b0 + k) % n : ((b0 - k) % n + n) % n];
+		if(b->state != BLOCK_DONE) return 0;
+		for(i = 0; i < b->n; i++){
+			int j = dir == 1 ? i : b->n - 1 - i;
+			int r = b->start + b->m[2 * j], c = b->m[2 * j + 1];
+			int ahead = dir == 1 ? (r > S->jrow || (r == S->jrow && c >= S->jcol))	// on the jump's side of the origin
+					     : (r < S->jrow || (r == S->jrow && c < S->jcol));
+			if(k == 0 ? ahead : (k < n || !ahead)){
+				*found = 1;
+				*outrow = r;
+				*outcol = c;
+				return 1;
+			}
+		}
+	}
+	return 1;
+}
+
+
+int editorSearchJump(){						// do the pending jump if we can; returns 1 when something changed on screen
+	struct searchState *S = &E.search;
+	int found, row, col;
+	if(S->jump == 0 || !editorSearchResolve(&found, &row, &col)) return 0;
+	S->jump = 0;
+	if(found){
+		E.cy = row;
+		E.cx = col;
+		E.rowoff = E.numrows;					// scroll so the match line ends up at the top of the screen
+		E.match_row = row;
+		E.match_col = col;
+		E.match_len = S->qlen;
+	}else{
+		E.match_len = 0;
+	}
+	return 1;
+}
+
+
+int editorSearchPoll(){						// called while we wait for keys : 1 when the screen needs a redraw
+	struct searchState *S = &E.search;
+	if(S->query == NULL) return 0;
+	pthread_mutex_lock(&S->lock);
+	int changed = S->done != S->shown_done;
+	S->shown_done = S->done;
+	changed |= editorSearchJump();
+	pthread_mutex_unlock(&S->lock);
+	return changed;
+}
+
+
+void editorSearchWaitJump(int ms){				// give the workers a moment to find the match, small files then feel instant
+	struct searchState *S = &E.search;
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += ms * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+	editorRowCloseGap();
+	pthread_rwlock_unlock(&E.rowlock);			// the workers need the rows
+	pthread_mutex_lock(&S->lock);
+	while(S->jump && !editorSearchJump()){
+		if(pthread_cond_timedwait(&S->progress, &S->lock, &deadline) == ETIMEDOUT) break;
+	}
+	pthread_mutex_unlock(&S->lock);
+	pthread_rwlock_wrlock(&E.rowlock);
+}
+
+
+void editorFindCallback(char *query, int key){			// called by editorPrompt after each key while the user types the query
+	struct searchState *S = &E.search;
+
+	if(key == '\r'){						// stay here, the scan goes on to finish the count
+		pthread_mutex_lock(&S->lock);
+		S->jump = 0;
+		pthread_mutex_unlock(&S->lock);
+		E.match_len = 0;
+		return;
+	}
+	if(key == '\x1b' || query[0] == '\0'){
+		editorSearchStop();
+		return;
+	}
+
+	int row = E.match_len ? E.match_row : E.cy;			// we move on from the current match, or from the cursor
+	int col = E.match_len ? E.match_col : E.cx;
+	int dir = 1;
+	if(key == ARROW_RIGHT || key == ARROW_DOWN){			// next match
+		col++;
+	}else if(key == ARROW_LEFT || key == ARROW_UP){			// previous match
+		dir = -1;
+	}else if(S->query == NULL || strcmp(S->query, query) != 0){	// the query changed : the current match may still be good
+		editorSearchStart(query, row);
+	}
+	if(S->query == NULL) return;
+	if(row >= E.numrows) row = E.numrows ? E.numrows - 1 : 0;
+
+	pthread_mutex_lock(&S->lock);
+	S->jump = dir;
+	S->jrow = row;
+	S->jcol = col;
+	pthread_mutex_unlock(&S->lock);
+	editorSearchWaitJump(MINOCH_SEARCH_WAIT_MS);
+}
+
+
+void editorFind(){
+	int saved_cx = E.cx, saved_cy = E.cy;
+	int saved_coloff = E.coloff, saved_rowoff = E.rowoff, saved_wrapoff = E.wrap.off;
+
+	char *query = editorPrompt("Search : %s (ESC = cancel | Arrows = prev/next | Enter = stay here)", editorFindCallback);
+	if(query){
+		free(query);
+	}else{								// cancelled : back where we were
+		E.cx = saved_cx;
+		E.cy = saved_cy;
+		E.coloff = saved_coloff;
+		E.rowoff = saved_rowoff;
+		E.wrap.off = saved_wrapoff;
+	}
+}
+
+
+
+
+/**** Replace ****/
+
+/* Ctrl-R replaces every match of a string. typing the change would go through editorRowDelChar / editorRowInsertChar, an
+ update of the row per char, so here the workers of the pool first find the matches (blocks of rows, like the search, but
+ without overlaps), then each affected row gets its new chars allocated once, the workers fill them in parallel from the old
+ text, and the rows take them with one editorUpdateRow each. the undo log and the journal keep the whole thing as one
+ record : the matches as (row, col) int pairs, in order, then the two strings. undoing it replaces the other way around at
+ the same places, shifted by the matches before them on their row. the strings have no newlines, rows never move. */
+
+void editorReplaceScanRow(struct searchBlock *b, int at, erow *row, const char *q, int qlen){	// matches that don't overlap, as (at, col)
+	const char *data = editorRowData(row);
+	int from = 0;
+	while(from <= row->size - qlen){
+		const char *p = editorMemmem(data + from, row->size - from, q, qlen);
+		if(p == NULL) break;
+		editorMatchPush(b, at, p - data);
+		from = p - data + qlen;
+	}
+}
+
+
+void editorReplaceBuildRow(struct replaceRow *rr){			// write the new chars of a row
+	struct replaceState *R = &E.replace;
+	erow *row = editorRowAt(rr->row);
+	const char *src = editorRowData(row);
+	const int *m = R->m + 2 * rr->first;
+	char *out = rr->chars;
+	int at = 0, j;
+	for(j = 0; j < rr->n; j++){
+		int c = m[2 * j + 1];
+		memcpy(out, src + at, c - at);
+		out += c - at;
+		memcpy(out, R->to, R->tlen);
+		out += R->tlen;
+		at = c + R->flen;
+	}
+	memcpy(out, src + at, row->size - at);
+	out[row->size - at] = '\0';
+}
+
+
+void editorReplaceJob(int id){						// what every worker runs for a replace
+	struct replaceState *R = &E.replace;
+	int k;
+	(void)id;
+	if(R->pass == 0){
+		while((k = __atomic_fetch_add(&R->next, 1, __ATOMIC_RELAXED)) < R->nblocks){
+			struct searchBlock *b = &R->blocks[k];
+			long long bytes = 0;
+			int r;
+			for(r = b->start; r < b->end; r++){
+				erow *row = editorRowAt(r);
+				editorReplaceScanRow(b, r, row, R->from, R->flen);
+				bytes += row->size;
+			}
+			__atomic_fetch_add(&R->bytes, bytes, __ATOMIC_RELAXED);
+		}
+		return;
+	}
+	while((k = __atomic_fetch_add(&R->next, MINOCH_REPLACE_ROWS, __ATOMIC_RELAXED)) < R->nrows){
+		int end = k + MINOCH_REPLACE_ROWS < R->nrows ? k + MINOCH_REPLACE_ROWS : R->nrows;
+		for(; k < end; k++) editorReplaceBuildRow(&R->rows[k]);
+	}
+}
+
+
+void editorReplacePass(int pass, int n){				// run a pass over n blocks / rows, on the workers if there is enough
+	E.replace.pass = pass;
+	E.replace.next = 0;
+	if(n <= (pass == 0 ? 1 : MINOCH_REPLACE_ROWS)){			// not worth waking the threads up
+		E.replace.threads = 1;
+		editorReplaceJob(0);
+		return;
+	}
+	editorPoolStart(editorReplaceJob);
+	editorPoolWait();
+	E.replace.threads = E.pool.nthreads;
+}
+
+
+int editorReplaceRun(const int *m, int n, const char *f, int flen, const char *t, int tlen){	// replace f by t at the matches m;
+	struct replaceState *R = &E.replace;							// returns the nb of rows changed
+	int nrows = 0, j, k;
+	if(n == 0) return 0;
+	editorSearchStop();						// its workers would keep the pool (and the rows) busy
+	editorRowCloseGap();						// the workers read the rows in one piece
+	for(j = 0; j < n; j++)
+		if(j == 0 || m[2 * j] != m[2 * j - 2]) nrows++;
+	R->rows = malloc(sizeof(struct replaceRow) * nrows);
+	if(R->rows == NULL) die("malloc");
+	for(j = 0, k = -1; j < n; j++){					// the row allocator is not thread safe : new chars come from here
+		if(k >= 0 && m[2 * j] == R->rows[k].row){
+			R->rows[k].n++;
+			continue;
+		}
+		struct replaceRow *rr = &R->rows[++k];
+		rr->row = m[2 * j];
+		rr->first = j;
+		rr->n = 1;
+		if(k > 0){
+			struct replaceRow *prev = &R->rows[k - 1];
+			prev->size = editorRowAt(prev->row)->size + prev->n * (tlen - flen);
+			prev->chars = editorCharsAlloc(prev->size + 1, &prev->ccap);
+		}
+	}
+	struct replaceRow *last = &R->rows[k];
+	last->size = editorRowAt(last->row)->size + last->n * (tlen - flen);
+	last->chars = editorCharsAlloc(last->size + 1, &last->ccap);
+
+	R->from = f;
+	R->flen = flen;
+	R->to = t;
+	R->tlen = tlen;
+	R->m = m;
+	R->nrows = nrows;
+	editorReplacePass(1, nrows);
+
+	int cx = E.cx;							// the cursor moves with the matches before it on its row
+	for(j = 0; j < n && m[2 * j] <= E.cy; j++){
+		int c = m[2 * j + 1];
+		if(m[2 * j] < E.cy) continue;
+		if(c >= E.cx) break;
+		cx = c + flen <= E.cx ? cx + tlen - flen : c + cx - E.cx;	// (inside a match : to the start of what replaced it)
+	}
+
+	for(j = 0; j < nrows; j++){					// swap them in : one update per row, not per char
+		struct replaceRow *rr = &R->rows[j];
+		erow *row = editorRowAt(rr->row);
+		editorCharsFree(row->chars, row->ccap);
+		row->chars = rr->chars;
+		row->ccap = rr->ccap;
+		row->size = rr->size;
+		editorUpdateRow(row);
+	}
+	free(R->rows);
+	R->rows = NULL;
+	E.dirty++;
+	if(E.cy < E.numrows){
+		erow *row = editorRowAt(E.cy);
+		E.cx = cx < row->size ? cx : row->size;
+		for(j = 0; j < 3 && E.cx > 0 && E.cx < row->size && ((unsigned char)editorRowCharAt(row, E.cx) & 0xC0) == 0x80; j++)
+			E.cx--;						// never in the middle of a utf-8 char
+	}
+	return nrows;
+}
+
+
+char *editorReplaceText(int n, const char *f, int flen, const char *t, int tlen, int *len){	// room for n matches, then f and t
+	*len = 8 * n + flen + tlen;
+	char *text = malloc(*len);
+	if(text == NULL) die("malloc");
+	memcpy(text + 8 * n, f, flen);
+	memcpy(text + 8 * n + flen, t, tlen);
+	return text;
+}
+
+
+void editorReplaceUndo(struct undoRec *rec, int undo){			// replay a replace record forward (redo) or backward (undo)
+	int flen = rec->erow, tlen = rec->ecol;
+	int n = (rec->len - flen - tlen) / 8, len, j, k;
+	const int *m = (const int *)rec->text;
+	const char *f = rec->text + 8 * n, *t = f + flen;
+	if(!undo){
+		editorJournalReplace(rec->text, rec->len, flen, tlen);
+		editorReplaceRun(m, n, f, flen, t, tlen);
+	}else{								// t is now where f was : later matches on a row moved
+		char *text = editorReplaceText(n, t, tlen, f, flen, &len);
+		int *u = (int *)text;
+		for(j = 0, k = 0; j < n; j++){
+			k = j > 0 && m[2 * j] == m[2 * j - 2] ? k + 1 : 0;
+			u[2 * j] = m[2 * j];
+			u[2 * j + 1] = m[2 * j + 1] + k * (tlen - flen);
+		}
+		editorJournalReplace(text, len, tlen, flen);
+		editorReplaceRun(u, n, t, tlen, f, flen);
+		free(text);
+	}
+	E.cy = m[0];
+	E.cx = m[1];
+}
+
+
+int editorReplaceReplay(const char *text, int len, int flen, int tlen){	// a replace record of the journal; 0 if it doesn't fit the rows
+	if(flen <= 0 || tlen < 0 || len - flen - tlen <= 0 || (len - flen - tlen) % 8) return 0;
+	int n = (len - flen - tlen) / 8, j;
+	char *copy = malloc(len);					// the pairs are not aligned in the journal
+	if(copy == NULL) die("malloc");
+	memcpy(copy, text, len);
+	const int *m = (const int *)copy;
+	const char *f = copy + 8 * n, *t = f + flen;
+	for(j = 0; j < n; j++){						// in order, no overlap, and f really is there
+		int r = m[2 * j], c = m[2 * j + 1];
+		if(r < 0 || r >= E.numrows || c < 0 || c > editorRowAt(r)->size - flen
+			|| (j > 0 && (r < m[2 * j - 2] || (r == m[2 * j - 2] && c < m[2 * j - 1] + flen)))
+			|| memcmp(editorRowData(editorRowAt(r)) + c, f, flen) != 0){
+			free(copy);
+			return 0;
+		}
+	}
+	editorUndoReplace(copy, len, flen, tlen);
+	editorReplaceRun(m, n, f, flen, t, tlen);
+	E.cy = m[0];
+	E.cx = m[1];
+	free(copy);
+	return 1;
+}
+
+
+void editorReplaceAll(const char *f, const char *t){
+	struct replaceState *R = &E.replace;
+	int flen = strlen(f), tlen = strlen(t), j;
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	editorSearchStop();
+	editorRowCloseGap();
+	R->from = f;
+	R->flen = flen;
+	R->nblocks = (E.numrows + MINOCH_SEARCH_BLOCK - 1) / MINOCH_SEARCH_BLOCK;
+	R->blocks = calloc(R->nblocks ? R->nblocks : 1, sizeof(struct searchBlock));
+	if(R->blocks == NULL) die("calloc");
+	for(j = 0; j < R->nblocks; j++){
+		R->blocks[j].start = j * MINOCH_SEARCH_BLOCK;
+		R->blocks[j].end = (j + 1) * MINOCH_SEARCH_BLOCK < E.numrows ? (j + 1) * MINOCH_SEARCH_BLOCK : E.numrows;
+	}
+	R->bytes = 0;
+	editorReplacePass(0, R->nblocks);
+	int threads = R->threads;
+
+	long n = 0;
+	for(j = 0; j < R->nblocks; j++) n += R->blocks[j].n;
+	char *text = NULL;
+	int len = 0, nrows = 0;
+	if(n > 0 && n <= (INT_MAX - flen - tlen) / 8){			// the undo record holds them all
+		text = editorReplaceText(n, f, flen, t, tlen, &len);
+		int *m = (int *)text;
+		for(j = 0; j < R->nblocks; j++){
+			memcpy(m, R->blocks[j].m, sizeof(int) * 2 * R->blocks[j].n);
+			m += 2 * R->blocks[j].n;
+		}
+	}
+	for(j = 0; j < R->nblocks; j++) free(R->blocks[j].m);
+	free(R->blocks);
+	R->blocks = NULL;
+	if(n == 0){
+		editorSetStatusMessage("No match for %.40s", f);
+		return;
+	}
+	if(text == NULL){
+		editorSetStatusMessage("%ld matches, too many to undo : nothing replaced", n);
+		return;
+	}
+	editorUndoReplace(text, len, flen, tlen);
+	nrows = editorReplaceRun((int *)text, n, f, flen, t, tlen);
+	free(text);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	double mb = R->bytes / 1048576.0;
+	editorSetStatusMessage("%ld replaced on %d lines, %.1f MB in %.3fs (%.0f MB/s, %d threads)", n, nrows, mb, secs,
+		mb / (secs > 0 ? secs : 1e-9), threads);
+}
+
+
+void editorReplace(){
+	char *f = editorPrompt("Replace all : %s (ESC = cancel)", NULL);
+	if(f == NULL) return;
+	char *t = editorPrompt("Replace with : %s (ESC = cancel)", NULL);
+	if(t) editorReplaceAll(f, t);
+	free(f);
+	free(t);
 }
 
 
-void editorInsertNewline(){
 
-	if(E.cx == 0 ){						// if we'r at the begining of a line,  insert a blank row 
-		editorInsertRow(E.cy, "", 0);
-	}else{
-	  erow *row = &E.row[E.cy];
-	  editorInsertRow(E.cy +1, &row->chars[E.cx], row->size - E.cx);
-	  row = &E.row[E.cy];
-	  row->size = E.cx;
-	  row->chars[row->size] = '\0';
-	  editorUpdateRow(row);
+/**** Worker pool ****/
+
+// one thread per cpu, started the first time we need them. editorPoolStart() makes every worker run the same job function once,
+// the job shares the work out itself (like the search workers grabbing blocks of rows from a counter).
+
+void *editorWorkerMain(void *arg){
+	int id = (int)(long)arg;
+	unsigned long seen = 0;
+	pthread_mutex_lock(&E.pool.lock);
+	while(1){
+		while(E.pool.gen == seen) pthread_cond_wait(&E.pool.wake, &E.pool.lock);
+		seen = E.pool.gen;
+		void (*job)(int) = E.pool.job;
+		pthread_mutex_unlock(&E.pool.lock);
+		job(id);
+		pthread_mutex_lock(&E.pool.lock);
+		if(--E.pool.running == 0) pthread_cond_broadcast(&E.pool.idle);
 	}
-	E.cy++;
-	E.cx =0;
+	return NULL;
 }
 
 
+void editorPoolWait(){						// wait for the current job to be over (don't hold E.rowlock if it needs the rows !)
+	pthread_mutex_lock(&E.pool.lock);
+	while(E.pool.running) pthread_cond_wait(&E.pool.idle, &E.pool.lock);
+	pthread_mutex_unlock(&E.pool.lock);
+}
+
 
+void editorPoolStart(void (*job)(int)){				// run job on every worker, returns right away
+	if(E.pool.nthreads == 0){
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		if(n < 1) n = 1;
+		if(n > MINOCH_MAX_WORKERS) n = MINOCH_MAX_WORKERS;
+		E.pool.threads = malloc(sizeof(pthread_t) * n);
+		if(E.pool.threads == NULL) die("malloc");
+		long j;
+		for(j = 0; j < n; j++){
+			if(pthread_create(&E.pool.threads[j], NULL, editorWorkerMain, (void *)j) != 0) die("pthread_create");
+		}
+		E.pool.nthreads = n;
+	}
+	editorPoolWait();					// one job at a time
+	pthread_mutex_lock(&E.pool.lock);
+	E.pool.job = job;
+	E.pool.running = E.pool.nthreads;
+	E.pool.gen++;
+	pthread_cond_broadcast(&E.pool.wake);
+	pthread_mutex_unlock(&E.pool.lock);
+}
 
 
-void editorDelChar(){
 
-	if(E.cy == E.numrows)	return;					// if the cursor went after the end of the file, we just return  
-	if (E.cx == 0 && E.cy == 0) return;				//
+/**** Append buffer ****/
 
+// the buffers are reset (len = 0) and reused for every frame; they only grow, doubling, when a frame needs more than ever before.
+// E.frame_allocs counts those growths : once the screen has been drawn a couple of times it should not move anymore.
 
-	erow *row = &E.row[E.cy];					// we get the errow where the cursor is ..
-	if(E.cx > 0){							//if we'r not at the begining of the line 
-		editorRowDelChar(row, E.cx-1);				// delete char and
-		E.cx--;							//decrement cursor on x axis ! 
-	} else {
-    	E.cx = E.row[E.cy - 1].size;
-    	editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-    	editorDelRow(E.cy);
-    	E.cy--;
-  	}
+void abReserve(struct abuf *ab, int len){			// make sure len more bytes fit without reallocating
+	if(ab->len + len <= ab->cap) return;
+	int cap = ab->cap ? ab->cap : 256;
+	while(cap < ab->len + len) cap *= 2;
+	char *new = realloc(ab->b, cap);
+	if(new == NULL) die("realloc");
+	ab->b = new;
+	ab->cap = cap;
+	E.frame_allocs++;
 }
 
+void abAppend(struct abuf *ab, const char *s, int len){
+	abReserve(ab, len);
+	memcpy(&ab->b[ab->len], s, len);
+	ab->len += len;
+}
 
+void abFill(struct abuf *ab, char c, int n){			// append n times the same char (padding)
+	if(n <= 0) return;
+	abReserve(ab, n);
+	memset(&ab->b[ab->len], c, n);
+	ab->len += n;
+}
 
+void abReset(struct abuf *ab){					// empty the buffer but keep its memory for next time
+	ab->len = 0;
+}
 
+void abFree(struct abuf *ab){
+	free(ab->b);
+	ab->b = NULL;
+	ab->len = ab->cap = 0;
+	}
 
 
 
-/*** File i/o ***/
-
-char *editorRowsToString(int *buflen){		// this function transforms all the rows in one string to store it in a file on disk 
-	int totlen =0;
-	int j;
-	for(j=0; j< E.numrows; j++)			// we add up all the lines sizes (the +1 is for the '\n' at the end of each line)
-		totlen += E.row[j].size +1;
-	*buflen = totlen;				// we store the lenght on buflen 
+/**** Perf overlay ****/
 
-	char *buf = malloc(totlen);			// we allocate memory
-	char *p = buf;
-	for(j=0; j < E.numrows; j++){			// and loop over the lines
-		memcpy(p, E.row[j].chars, E.row[j].size);		//copy the content of the lines in the 'p' buffer
-		p += E.row[j].size;
-		*p = '\n';							// add the '\n'
-		p++;	
-	}
+/* every frame records how long it took to build, how many bytes it sent and, when it follows keys, how long it's been since
+ they came in : a clock_gettime (vdso, no syscall) at each end and a log2 histogram, always on. Ctrl-P shows the last value
+ and the p99 (the top of the bucket it falls in) in the message bar with the row count and the memory of the rows' chars,
+ the render cache and the output buffers. --perf-log FILE appends the histograms to FILE at exit. */
 
-	return buf;
+unsigned long long editorPerfNow(){						// monotonic clock, nanoseconds
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
 
+void editorPerfAdd(struct perfHist *h, unsigned long long v){
+	h->n[63 - __builtin_clzll(v | 1)]++;
+	h->count++;
+	h->last = v;
+}
 
 
-void editorOpen(char *filename) {			// function to open files, we read line by line from the file we want to open !
+unsigned long long editorPerfP99(struct perfHist *h){				// upper bound of the 99th percentile
+	unsigned long seen = 0, want = h->count - h->count / 100;
+	int b;
+	for(b = 0; b < 64; b++){
+		seen += h->n[b];
+		if(seen >= want && seen) return b == 63 ? ~0ULL : (2ULL << b) - 1;
+	}
+	return 0;
+}
 
-free(E.filename);
-E.filename = strdup(filename);  				//get filename and store it ! strdup from string.h makes a copy of its argument
 
-FILE *fp = fopen(filename, "r");
-  if(!fp) die("fopen");
+void editorPerfFrame(unsigned long long t0, unsigned long long t1, int bytes){	// end of editorRefreshScreen
+	editorPerfAdd(&E.perf.frame, t1 - t0);
+	if(bytes) editorPerfAdd(&E.perf.bytes, bytes);
+	if(E.perf.key_t0){
+		editorPerfAdd(&E.perf.key, editorPerfNow() - E.perf.key_t0);
+		E.perf.key_t0 = 0;
+	}
+}
 
-  char *line = NULL;
-  size_t linecap = 0;
-  ssize_t linelen;
-  while ((linelen = getline(&line, &linecap, fp)) != -1) {
-    while (linelen > 0 && (line[linelen - 1] == '\n' ||
-	                   line[linelen - 1] == '\r'))
-      linelen--;
-    
-    editorInsertRow(E.numrows, line, linelen);
-  }
-  free(line);
-  fclose(fp);
-  E.dirty = 0;
+
+int editorPerfTime(char *buf, int size, unsigned long long ns){
+	if(ns < 1000) return snprintf(buf, size, "%lluns", ns);
+	if(ns < 1000000) return snprintf(buf, size, "%lluus", ns / 1000);
+	return snprintf(buf, size, "%.1fms", ns / 1e6);
 }
 
 
+int editorPerfBytes(char *buf, int size, unsigned long long n){
+	if(n < 1024) return snprintf(buf, size, "%lluB", n);
+	if(n < 1048576) return snprintf(buf, size, "%.1fK", n / 1024.0);
+	return snprintf(buf, size, "%.1fM", n / 1048576.0);
+}
 
-void editorSave(){
-	if(E.filename == NULL){
-		E.filename = editorPrompt("Save as : %s (ESC to cancel)");
-		if(E.filename == NULL){
-			editorSetStatusMessage("Save Canceled");
-			return;
-		}
-	}
 
-	int len;
-	char *buf = editorRowsToString(&len);
-
-	int fd = open(E.filename, O_RDWR | O_CREAT, 0644);       	// O_RDWR : open for read/write.  O_CREAT : to create the file if it doesnt exist ! 0644 the permissions !
-	if (fd != -1) {
-    		if (ftruncate(fd, len) != -1) {
-      			if (write(fd, buf, len) == len) {
-        			close(fd);
-        			free(buf);
-				E.dirty = 0;
-				editorSetStatusMessage("Saving ...");
-        			return;
-      			}
-    		}
-    		close(fd);
-  	}
-	free(buf);
-	editorSetStatusMessage("Error while saving : %s",  strerror(errno));				//strerror from string.h takes errno global as argument and prints human readable message error
+void editorPerfDraw(struct abuf *line){						// the overlay, in place of the status message
+	size_t render = sizeof(struct renderSlot) * E.rcachelen, out = E.ob.cap + E.lb.cap;
+	int j;
+	for(j = 0; j < E.rcachelen; j++)
+		render += E.rcache[j].cap + E.rcache[j].hlcap + sizeof(struct tabStop) * E.rcache[j].tabcap;
+	for(j = 0; j < E.framelines; j++) out += E.frame[j].line.cap;
+
+	char f[16], fp[16], b[16], k[16], kp[16], c[16], r[16], o[16], s[160];
+	editorPerfTime(f, sizeof(f), E.perf.frame.last);
+	editorPerfTime(fp, sizeof(fp), editorPerfP99(&E.perf.frame));
+	editorPerfBytes(b, sizeof(b), E.perf.bytes.last);
+	editorPerfTime(k, sizeof(k), E.perf.key.last);
+	editorPerfTime(kp, sizeof(kp), editorPerfP99(&E.perf.key));
+	editorPerfBytes(c, sizeof(c), E.rowmem.slabbytes + E.rowmem.bigbytes);
+	editorPerfBytes(r, sizeof(r), render);
+	editorPerfBytes(o, sizeof(o), out);
+	int len = snprintf(s, sizeof(s), "frm %s/%s %s key %s/%s | %d rows | chars %s rend %s out %s",
+		f, fp, b, k, kp, E.numrows, c, r, o);
+	abAppend(line, s, len < (int)sizeof(s) ? len : (int)sizeof(s) - 1);
 }
 
 
+void editorPerfDumpHist(FILE *fp, const char *name, struct perfHist *h){
+	int b;
+	fprintf(fp, "%s : %lu values, last %llu, p99 < %llu\n", name, h->count, h->last, editorPerfP99(h));
+	for(b = 0; b < 64; b++)
+		if(h->n[b]) fprintf(fp, "  %20llu %20llu %10lu\n", b ? 1ULL << b : 0, b == 63 ? ~0ULL : (2ULL << b) - 1, h->n[b]);
+}
 
 
-/**** Append buffer ****/
+void editorPerfDump(){								// atexit, with --perf-log
+	FILE *fp = fopen(E.perf.log, "a");
+	if(fp == NULL) return;
+	fprintf(fp, "# minoch %s, pid %d : from to count\n", E.bench.on ? E.bench.name : E.filename ? E.filename : "-", (int)getpid());
+	editorPerfDumpHist(fp, "frame_ns", &E.perf.frame);
+	editorPerfDumpHist(fp, "frame_bytes", &E.perf.bytes);
+	editorPerfDumpHist(fp, "key_to_paint_ns", &E.perf.key);
+	fclose(fp);
+}
 
-struct abuf {							//the buffer that will temporarly store what we want to write in the screen of our editor (like welcome msg for ex..)
-	char *b;
-	int len;
-		
-};
 
-#define ABUF_INIT {NULL, 0}
 
-void abAppend(struct abuf *ab, const char *s, int len){
-	char *new = realloc(ab->b, ab->len + len);
-	
-	if (new == NULL) return;
-	memcpy(&new[ab->len], s, len);
-	ab->b = new;
-	ab->len += len;
-	
-}
+/**** Output ****/
 
-void abFree(struct abuf *ab){
-	free(ab->b);
+void editorGutterUpdate(){						// the gutter is as wide as the last line number, plus a space
+	int w = 0;
+	if(E.linenums){
+		int n;
+		for(w = 2, n = E.numrows; n >= 10; n /= 10) w++;
+		if(w > E.termcols / 2) w = 0;				// a very narrow terminal keeps its columns for the text
 	}
+	E.gutter = w;
+	E.screencols = E.termcols - w;
+}
 
 
+void editorDrawGutter(struct abuf *line, int filerow){		// filerow + 1 right-aligned, -1 : blank (past the end, or a wrapped line)
+	char num[16];
+	if(filerow < 0){
+		abFill(line, ' ', E.gutter);
+		return;
+	}
+	int len = snprintf(num, sizeof(num), "%*d ", E.gutter - 1, filerow + 1);
+	abAppend(line, num, len);
+}
 
-/**** Output ****/
 
 void editorScroll(){	
  	E.rx = 0;
 	if (E.cy < E.numrows) {
-		E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+		E.rx = editorRowCxToRx(editorRowAt(E.cy), E.cx);
+	}
+	if (E.wrap.on) {							// no sideways scrolling, see Soft wrap
+		editorWrapScroll();
+		return;
 	}
 
 //Vertical scrolling 	
@@ -472,18 +4556,157 @@ void editorScroll(){
    		E.coloff = E.rx;
   	}
 
-	if(E.rx > E.coloff + E.screencols){
-		E.coloff = E.rx - E.screencols +1;
+	int cw = 1;								// a wide char under the cursor needs both its columns on screen
+	if (E.cy < E.numrows && E.cx < editorRowAt(E.cy)->size) {
+		int cp;
+		editorRowDecodeAt(editorRowAt(E.cy), E.cx, &cp);
+		cw = editorCharWidth(cp) > 1 ? 2 : 1;
+	}
+	if(E.rx + cw > E.coloff + E.screencols){
+		E.coloff = E.rx + cw - E.screencols;
+	}
+}
+
+
+
+
+/* Frame diffing : E.frame keeps what we sent for every line of the screen last time (text rows, status bar, message bar).
+ A line whose bytes did not change is not sent again, a changed line is sent starting at the first column that differs.
+ When the view just moved up or down a few rows we let the terminal scroll its text area itself, so only the new rows are sent. */
+
+unsigned int editorHashLine(const char *s, int len){		// FNV-1a, cheap way to spot unchanged lines before comparing bytes
+	unsigned int h = 2166136261u;
+	int j;
+	for(j = 0; j < len; j++){
+		h ^= (unsigned char)s[j];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+void editorFrameResize(int lines){				// (re)allocate the shadow frame, the next refresh repaints everything
+	int j;
+	for(j = 0; j < E.framelines; j++) abFree(&E.frame[j].line);
+	free(E.frame);
+	E.frame = calloc(lines, sizeof(struct frameLine));
+	if(E.frame == NULL) die("calloc");
+	E.framelines = lines;
+	E.frame_valid = 0;
+
+	int linebytes = E.termcols * MINOCH_COLUMN_BYTES + 32;		// size the buffers for a full screen now, so that a bar showing up
+	for(j = 0; j < lines; j++) abReserve(&E.frame[j].line, linebytes);	// for the first time later on does not grow them mid-session
+	abReserve(&E.lb, linebytes);
+	abReserve(&E.ob, lines * (linebytes + 32));			// (+ the cursor moves in front of each line)
+}
+
+
+void editorEmitLine(struct abuf *ab, int y, const char *s, int len){	// send screen line y if it differs from what the terminal shows
+	struct frameLine *fl = &E.frame[y];
+	unsigned int h = editorHashLine(s, len);
+	if(E.frame_valid && fl->hash == h && fl->line.len == len && memcmp(fl->line.b, s, len) == 0)
+		return;
+
+	int p = 0;							// skip the common beginning, as long as bytes are plain chars bytes = columns
+	if(E.frame_valid){
+		while(p < len && p < fl->line.len && s[p] == fl->line.b[p] && s[p] >= ' ' && s[p] < 127) p++;
+		int j;
+		for(j = 0; j < p; j++)					// an escape sequence after the common part may depend on what came before, play safe
+			if(s[j] == '\x1b') { p = 0; break; }
+	}
+
+	char buf[32];
+	int blen = snprintf(buf, sizeof(buf), "\x1b[%d;%dH\x1b[K", y + 1, p + 1);	// go there and clear the rest of the old line first
+	abAppend(ab, buf, blen);						// (clearing after the text would eat the last column of a full width line)
+	abAppend(ab, s + p, len - p);
+
+	abReset(&fl->line);						// remember what is on screen now
+	abAppend(&fl->line, s, len);
+	fl->hash = h;
+}
+
+
+void editorFrameScroll(struct abuf *ab){			// the view moved by less than a screen : make the terminal scroll the text rows
+	int delta = E.rowoff - E.frame_rowoff;
+	if(E.wrap.on){							// in screen lines : rows take more than one
+		int from = E.wrap.frame_rowoff < E.numrows ? E.wrap.frame_rowoff : E.numrows;
+		long d = editorWrapLine(E.rowoff) + E.wrap.off - editorWrapLine(from) - E.wrap.frame_off;
+		delta = d > E.screenrows ? E.screenrows : d < -E.screenrows ? -E.screenrows : d;
+	}
+	if(!E.frame_valid || delta == 0 || E.coloff != E.frame_coloff) return;
+	if(delta >= E.screenrows || -delta >= E.screenrows) return;	// nothing to keep, plain repaint
+
+	char buf[48];
+	int n = delta > 0 ? delta : -delta;
+	int blen = snprintf(buf, sizeof(buf), "\x1b[1;%dr\x1b[%d%c\x1b[r", E.screenrows, n, delta > 0 ? 'S' : 'T');	// scroll region = text rows, scroll up (S) or down (T), reset region
+	abAppend(ab, buf, blen);
+
+	struct frameLine tmp[n];					// rotate the shadow lines the same way, the rows coming in are blank on screen
+	int y;
+	if(delta > 0){
+		memcpy(tmp, E.frame, sizeof(struct frameLine) * n);
+		memmove(E.frame, E.frame + n, sizeof(struct frameLine) * (E.screenrows - n));
+		memcpy(E.frame + E.screenrows - n, tmp, sizeof(struct frameLine) * n);
+		for(y = E.screenrows - n; y < E.screenrows; y++){
+			E.frame[y].line.len = 0;
+			E.frame[y].hash = editorHashLine("", 0);
+		}
+	}else{
+		memcpy(tmp, E.frame + E.screenrows - n, sizeof(struct frameLine) * n);
+		memmove(E.frame + n, E.frame, sizeof(struct frameLine) * (E.screenrows - n));
+		memcpy(E.frame, tmp, sizeof(struct frameLine) * n);
+		for(y = 0; y < n; y++){
+			E.frame[y].line.len = 0;
+			E.frame[y].hash = editorHashLine("", 0);
+		}
 	}
 }
 
 
+void editorDrawRow(struct abuf *line, int filerow, struct renderSlot *rs){	// the columns [E.coloff, E.coloff + E.screencols) of a row
+	erow *row = editorRowAt(filerow);
+	unsigned char *hl = editorRowHighlight(row, filerow, rs);
+	int c0, c1;
+	int off = editorRenderColByte(rs, E.coloff, &c0);	// render bytes of the columns on screen, see UTF-8
+	int len = editorRenderColEnd(rs, off, c0, E.coloff + E.screencols) - off;
+	abFill(line, ' ', c0 - E.coloff);			// the right half of a wide char cut by the left edge
+	int m0 = 0, m1 = 0;
+	if (E.match_len && filerow == E.match_row) {	// show the search match in inverted colors
+		m0 = editorRenderColByte(rs, editorRowCxToRx(row, E.match_col), &c1) - off;
+		m1 = editorRenderColByte(rs, editorRowCxToRx(row, E.match_col + E.match_len), &c1) - off;
+		if (m0 < 0) m0 = 0;
+		if (m1 > len) m1 = len;
+	}
+	if (hl == NULL && m0 >= m1) {
+		abAppend(line, &rs->render[off], len);
+	} else {					// one escape sequence per run of the same color, the match is a "color" too
+		char *s = &rs->render[off];
+		int color = -1, start = 0, j;
+		for (j = 0; j < len; j++) {
+			int c = j >= m0 && j < m1 ? 7 : editorSyntaxToColor(hl ? hl[off + j] : HL_NORMAL);
+			if (c == color) continue;
+			abAppend(line, &s[start], j - start);
+			start = j;
+			if (color == 7) abAppend(line, "\x1b[m", 3);
+			char seq[16];
+			int clen = snprintf(seq, sizeof(seq), "\x1b[%dm", c == 37 ? 39 : c);
+			abAppend(line, seq, clen);
+			color = c;
+		}
+		abAppend(line, &s[start], len - start);
+		if (color != -1) abAppend(line, "\x1b[m", 3);
+	}
+}
 
 
 void editorDrawRows(struct abuf *ab){							//function that will draw the contour of our editor, print the welcome message and print the text (row by row) 			
+	struct abuf *line = &E.lb;						// each screen line is built here first, then diffed against the frame
 	int y;
+	int wrow = E.rowoff, wsub = E.wrap.off;				// soft wrap : the row and which of its lines we are at
 	for(y=0; y < E.screenrows; y++){
-		int filerow = y + E.rowoff;			// variable for row + offset (used for scrolling)
+		abReset(line);
+		int filerow = E.wrap.on ? wrow : y + E.rowoff;			// variable for row + offset (used for scrolling)
+		if (E.gutter) editorDrawGutter(line, filerow < E.numrows && (!E.wrap.on || wsub == 0) ? filerow : -1);
 		if (filerow >= E.numrows) {
 			if(E.numrows == 0 && y == E.screenrows / 3){
 				char welcome[100];
@@ -492,96 +4715,130 @@ void editorDrawRows(struct abuf *ab){							//function that will draw the contou
 				if (welcomelen > E.screencols) welcomelen = E.screencols;
 				int padding = (E.screencols - welcomelen) / 2;
 				if (padding) {
-					abAppend(ab, "*", 1);
+					abAppend(line, "*", 1);
 					padding --;
 				}
-				while (padding--) abAppend(ab, " ", 1);
-				abAppend(ab, welcome, welcomelen);
+				abFill(line, ' ', padding);
+				abAppend(line, welcome, welcomelen);
 			} 
 			else {
-				abAppend(ab, "*", 1);
+				abAppend(line, "*", 1);
+			}
+		}
+		else if (E.wrap.on) {					// line wsub of the row : its columns from wsub screen widths on
+			E.coloff = wsub * E.screencols;			// (long rows render a window around E.coloff)
+			struct renderSlot *rs = editorRowRender(editorRowAt(filerow));
+			editorDrawRow(line, filerow, rs);
+			if (++wsub >= editorWrapExact(filerow, rs)) {
+				wrow++;
+				wsub = 0;
 			}
+			E.coloff = 0;
 		}
 		else {
-			int len = E.row[filerow].rsize - E.coloff;
-			if (len < 0) len  = 0;
-			if (len > E.screencols) len = E.screencols;
-			abAppend(ab, &E.row[filerow].render[E.coloff], len);
-		}
-						
-		abAppend(ab, "\x1b[K", 3);						
-		abAppend(ab, "\r\n", 2);						//print new line at the end	
+			struct renderSlot *rs = editorRowRender(editorRowAt(filerow));	// rendered straight from the map, cached while it stays on screen
+			editorDrawRow(line, filerow, rs);
+		}
+		editorEmitLine(ab, y, line->b, line->len);
 		}	
 }
 
 
 
 void editorDrawStatusBar(struct abuf *ab) {
-  abAppend(ab, "\x1b[7m", 4);	 											// this escape sequence will invert the colors black txt on white background 
+  struct abuf *line = &E.lb;
+  abReset(line);
+  abAppend(line, "\x1b[7m", 4);	 											// this escape sequence will invert the colors black txt on white background 
   
   char status[100],nblinestatus[100];
-  int len = snprintf(status, sizeof(status), "%.20s : %d lines %s", E.filename ? E.filename : "Untitled Document", E.numrows, E.dirty ? "(modified)" : "");  	//preparing the filename & nb of lines
-  int nblinelen = snprintf(nblinestatus, sizeof(nblinestatus), "Current line :%d", E.cy +1); 				//preparing the nb of each line stored in E.cy; we add +1 becaus E.cy starts at 0
-  if (len > E.screencols) len = E.screencols;
-  abAppend(ab, status, len);												//printing the filename & nb of lines
-  while (len < E.screencols) {
-    if(E.screencols - len == nblinelen){
-	  abAppend(ab, nblinestatus, nblinelen);
-	  break;
-    }else{
-    	  abAppend(ab, " ", 1);
-	  len++;
-    }
+  int len = snprintf(status, sizeof(status), "%.20s : %d lines %s%s%s", E.filename ? E.filename : "Untitled Document", E.numrows, E.dirty ? "(modified)" : "",
+	E.follow.on ? " [follow]" : "", E.wrap.on ? " [wrap]" : "");  	//preparing the filename & nb of lines
+  int nblinelen = snprintf(nblinestatus, sizeof(nblinestatus), "Current line :%d (%d%%)", E.cy +1,
+	E.numrows > 1 ? (int)((long long)E.cy * 100 / (E.numrows - 1)) : 100); 				//preparing the nb of each line stored in E.cy; we add +1 becaus E.cy starts at 0
+  if (len > E.termcols) len = E.termcols;
+  abAppend(line, status, len);												//printing the filename & nb of lines
+  if (len + nblinelen <= E.termcols) {						// right-align the line nb, padding with spaces in one go
+	  abFill(line, ' ', E.termcols - len - nblinelen);
+	  abAppend(line, nblinestatus, nblinelen);
+  } else {
+	  abFill(line, ' ', E.termcols - len);
   }
-  abAppend(ab, "\x1b[m", 3);											// escape sequence that will make colors back to normal
-  abAppend(ab, "\r\n", 2);
+  abAppend(line, "\x1b[m", 3);											// escape sequence that will make colors back to normal
+  editorEmitLine(ab, E.screenrows, line->b, line->len);
 }
 
 
 
 
 void editorDrawMessageBar(struct abuf *ab) {																		
-	abAppend(ab, "\x1b[K", 3);										//escape sequence that Clears line from cursor right  !
+	struct abuf *line = &E.lb;
+	abReset(line);
 	int msglen = strlen(E.statusmsg);
-	if (msglen > E.screencols) msglen = E.screencols;							// we make sure the msg fits in the screen (comparing lenght with E.screencols)
-	if (msglen && time(NULL) - E.statusmsg_time < 5)							// we print the msg if it s 5 secondes old !
-	  abAppend(ab, E.statusmsg, msglen);
+	if (E.perf.show)
+	  editorPerfDraw(line);
+	else if (msglen && time(NULL) - E.statusmsg_time < MINOCH_STATUS_SECONDS)				// we print the msg if it s less than 5 secondes old !
+	  abAppend(line, E.statusmsg, msglen);
+	if (E.search.query) {											// search running : how many matches we know of
+	  char count[64];
+	  pthread_mutex_lock(&E.search.lock);
+	  int clen = snprintf(count, sizeof(count), "  [%ld matches%s]", E.search.count, E.search.done < E.search.nblocks ? " so far" : "");
+	  pthread_mutex_unlock(&E.search.lock);
+	  abAppend(line, count, clen);
+	}
+	if (line->len > E.termcols) line->len = E.termcols;						// we make sure the msg fits in the screen (comparing lenght with E.termcols)
+	editorEmitLine(ab, E.screenrows + 1, line->b, line->len);
 }
 
 
 
 
 void editorRefreshScreen(){		// we make a buffer that stores all what we want to write to the terminal, and then write to it at the end 												// function to clear the screen 	
+	unsigned long long t0 = editorPerfNow();
+	editorGutterUpdate();
 	editorScroll();	
-	struct abuf ab = ABUF_INIT;
+	struct abuf *ab = &E.ob;						// the frame buffer keeps its memory between frames
+	abReset(ab);
 	
-	abAppend(&ab, "\x1b[?25l", 6); // to hide the cursor
+	abAppend(ab, "\x1b[?25l", 6); // to hide the cursor
 	
-//	abAppend(&ab, "\x1b[2J", 4);	we comment this line becaus we want to clear each line alone, check editorDrwRows
+//	abAppend(ab, "\x1b[2J", 4);	we don't clear the screen : only the lines that changed since last frame are sent, check editorEmitLine
 /* 4 means we'r writing 4 bytes to terminal, first one is the hex \x1b = 27 in decimal  which is the escape character
  \x1b[2J is an escape sequence(responsible for text formatting like coloring text, clearning the screen) : they all start with 27[ : we are using J command that takes 2 as argument. that will clear the entire screen (<esc>[0J will clear the screen from cursor up to the end, <esc>[1J will clear screen up to where cursor is)
 */
 
-	abAppend(&ab, "\x1b[H", 3);
+	int before = ab->len;
+	editorFrameScroll(ab);
+	editorDrawRows(ab);
+	editorDrawStatusBar(ab);
+	editorDrawMessageBar(ab);
+	E.frame_valid = 1;
+	E.frame_rowoff = E.rowoff;
+	E.frame_coloff = E.coloff;
+	E.wrap.frame_rowoff = E.rowoff;
+	E.wrap.frame_off = E.wrap.off;
+
+	if(ab->len == before && E.cx == E.frame_cx && E.cy == E.frame_cy){	// nothing changed at all, nothing to send
+		editorPerfFrame(t0, editorPerfNow(), 0);
+		return;
+	}
+	E.frame_cx = E.cx;
+	E.frame_cy = E.cy;
+	
+	char buf[32];
+	if(E.wrap.on) snprintf(buf, sizeof(buf), "\x1b[%d;%dH", E.wrap.cury + 1, E.gutter + E.wrap.curx + 1);
+	else snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1, E.gutter + (E.rx - E.coloff) + 1);				// we add +1 becaus terminal indexing starts from 1 and not 0
 /* escape sequence with H command that reposition the cursor on the screen, takes  2 args row nb, and col nb :default arg are 1 so, if
  \x1b[H is the same as \x1b[1;1H and that will position the cursor on first row, first column (rows and cols are numbered starting from 1 not 0 )
-
 */
-
-	editorDrawRows(&ab);
-	editorDrawStatusBar(&ab);
-	editorDrawMessageBar(&ab);
-	
-	char buf[32];
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1, (E.rx - E.coloff) + 1);				// we add +1 becaus terminal indexing starts from 1 and not 0
-	abAppend(&ab, buf, strlen(buf));
+	abAppend(ab, buf, strlen(buf));
 	
 	
 
-	abAppend(&ab, "\x1b[?25h", 6);	// to show cursor back again
+	abAppend(ab, "\x1b[?25h", 6);	// to show cursor back again
 
-	write(STDOUT_FILENO, ab.b, ab.len);
-	abFree(&ab);
+	unsigned long long t1 = editorPerfNow();
+	editorTermWrite(ab->b, ab->len);
+	editorPerfFrame(t0, t1, ab->len);
 
 }
 
@@ -591,13 +4848,15 @@ void editorSetStatusMessage(const char *fmt, ...) {						// this is a "variadic"
 	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);					
 	va_end(ap);
 	E.statusmsg_time = time(NULL);								// current timestamp (nb of seconds from 1st jan 1970)
+	struct itimerspec expire = { { 0, 0 }, { E.statusmsg_time + MINOCH_STATUS_SECONDS, 0 } };
+	timerfd_settime(E.timerfd, TFD_TIMER_ABSTIME, &expire, NULL);				// wake up to erase it
 }
 
 
 
 /**** Input ****/
 
-char *editorPrompt(char *prompt){	//function that will ask  the user to enter namefile to be saved as 
+char *editorPrompt(char *prompt, void (*callback)(char *, int)){	//function that will ask  the user to enter namefile to be saved as (or the text to search for); callback gets every key
 
 	size_t bufsize = 128;				
 	char *buf = malloc(bufsize);					//allocate memory for the filename entered by the user; stored in a buffer first 
@@ -609,19 +4868,21 @@ char *editorPrompt(char *prompt){	//function that will ask  the user to enter na
 		editorSetStatusMessage(prompt, buf);
 		editorRefreshScreen();
 
-		int c = editorReadKet();				// wait for key press
+		int c = editorReadKey();				// wait for key press
 		if(c == BACKSPACE || c == CTRL_KEY('h')){		// we let the user delete from filename he is entering 
 			if(buflen != 0) buf[--buflen] = '\0';		// we test if he already input anything then start putting null byte decreasingly when he's deleting
 		}else if(c == '\x1b'){					// when input is cancelled 
 			editorSetStatusMessage("");			// we clear status message
+			if(callback) callback(buf, c);
 			free(buf);					// and free the buffer
 			return NULL;
 		}else if(c == '\r'){					// when user presses "enter"
 			if(buflen != 0){				// if the input is not empty 
 				editorSetStatusMessage("");		// we clear the status message
+				if(callback) callback(buf, c);
 				return buf;				// and return the user's input 
 			}			
-		}else if (!iscntrl(c) && c < 128){			// less than 128 means that it"s not a special keys; range of chars is 128  
+		}else if (c < 256 && !iscntrl(c)){			// less than 256 means that it"s not a special key but a byte (utf-8 ones too)
 			if(buflen == bufsize -1){			// if the buffer reachers it s max allocated space
 				bufsize *= 2;				// we double the bufsize and
 				buf = realloc(buf, bufsize);		// realloc memory with new size
@@ -629,6 +4890,7 @@ char *editorPrompt(char *prompt){	//function that will ask  the user to enter na
 		buf[buflen++] = c;					// when user input a char we append it to the buffer
 		buf[buflen] = '\0';					// we make shure that buffer ends with the null byte becaus other functions needs to know where the string ends 
 		}
+		if(callback) callback(buf, c);
 	}
 }
 
@@ -660,19 +4922,20 @@ char *editorPrompt(char *prompt){	//function that will ask  the user to enter na
 
 void editorMoveCursor(int key){					// function that maps arrow keys to moving x,y positions of cursor
 	
- 	erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+ 	erow *row = (E.cy >= E.numrows) ? NULL : editorRowAt(E.cy);
+	int rx = row ? editorRowCxToRx(row, E.cx) : 0;			// up and down keep the screen column, not the char index
 	switch(key){
 		case ARROW_LEFT:
 		  if(E.cx != 0){
-		    E.cx--;
+		    E.cx = editorRowPrevChar(row, E.cx);			// a whole char (and its combining marks) at a time
 		  }else if (E.cy > 0){				// if E.cx is Null and we'r not at the first line;(begining of a line and we press left)
 		    E.cy --;					// then move up one line 
-		    E.cx = E.row[E.cy].size;			// and put cursor at end of that line(the end of the line  = the size of text there !) 
+		    E.cx = editorRowAt(E.cy)->size;			// and put cursor at end of that line(the end of the line  = the size of text there !) 
 		  }
 		  break;
 		case ARROW_RIGHT:
 		  if (row && E.cx < row->size) {			// if there is a txt row and the cursor is not at the end  		
-		    E.cx++;						// then we can move to the right
+		    E.cx = editorRowNextChar(row, E.cx);		// then we can move to the right
 		  }else if (row && E.cx == row->size){			// however, when we get to the end of that txt line
 		    E.cy++;						// we need to go to next line 
 		    E.cx = 0;						// and put the cursor at the begining of that "next" line
@@ -681,16 +4944,18 @@ void editorMoveCursor(int key){					// function that maps arrow keys to moving x
 		case ARROW_UP:
 		  if(E.cy != 0){
 		    E.cy--;
+		    E.cx = editorRowRxToCx(editorRowAt(E.cy), rx);
 		  }
 		  break;
 		case ARROW_DOWN:
 		  if(E.cy < E.numrows){
 		    E.cy++;
+		    if(E.cy < E.numrows) E.cx = editorRowRxToCx(editorRowAt(E.cy), rx);
 		  }
 		  break;	
 	}
 
-	  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];			// we need to handle the situation where the cursor goes beyond the end of a line
+	  row = (E.cy >= E.numrows) ? NULL : editorRowAt(E.cy);			// we need to handle the situation where the cursor goes beyond the end of a line
   	  int rowlen = row ? row->size : 0;					// if row is null, its size is 0, else its size is the row->size
  	  if (E.cx > rowlen) {							// if the cursor goes beyond the end of the line to  the right (E.cx > rowlen) we bring it back to the end of the line 
    	  	E.cx = rowlen;
@@ -701,10 +4966,124 @@ void editorMoveCursor(int key){					// function that maps arrow keys to moving x
 
 
 
+/* Navigation : page jumps, goto-line (Ctrl-G), Ctrl-Home / Ctrl-End. the target row comes straight from the row index
+ (E.row is a gap buffer, editorRowAt is O(1)), and with soft wrap from the Fenwick tree of heights in O(log n), so going
+ to line 9,000,000 costs the same as going to line 10 : only the rows that end up on screen are rendered. */
+
+void editorPage(int dir){						// page up / down : the cursor and the text both move by a screen
+	if(E.wrap.on){							// by screen lines, see Soft wrap
+		editorWrapPage(dir);
+		return;
+	}
+	int rx = E.cy < E.numrows ? editorRowCxToRx(editorRowAt(E.cy), E.cx) : 0;
+	long cy = E.cy + (long)dir * E.screenrows;
+	long off = E.rowoff + (long)dir * E.screenrows;
+	if(cy < 0) cy = 0;
+	if(cy > E.numrows) cy = E.numrows;
+	if(off < 0) off = 0;
+	if(off > cy) off = cy;
+	E.cy = cy;
+	E.rowoff = off;
+	E.cx = E.cy < E.numrows ? editorRowRxToCx(editorRowAt(E.cy), rx) : 0;
+}
+
+
+void editorJumpTo(int row){						// put the cursor at the start of a row, centered on screen if it was off it
+	if(row > E.numrows - 1) row = E.numrows - 1;
+	if(row < 0) row = 0;
+	E.cy = row;
+	E.cx = 0;
+	if(E.numrows == 0) return;
+	if(!E.wrap.on){
+		if(row < E.rowoff || row >= E.rowoff + E.screenrows)
+			E.rowoff = row > E.screenrows / 2 ? row - E.screenrows / 2 : 0;
+		return;
+	}
+	if(E.wrap.cols != E.screencols) editorWrapRebuild();
+	long cur = editorWrapLine(row);
+	long top = E.rowoff < E.numrows ? editorWrapLine(E.rowoff) + E.wrap.off : editorWrapLine(E.numrows);
+	if(cur >= top && cur < top + E.screenrows) return;
+	top = cur - E.screenrows / 2;
+	if(top < 0) top = 0;
+	E.rowoff = editorWrapFind(top, &E.wrap.off);
+}
+
+
+void editorGoto(){							// Ctrl-G : a line number, a percentage of the file, or $ for the last line
+	char *q = editorPrompt("Go to line: %s (N, N%% or $, ESC to cancel)", NULL);
+	if(q == NULL) return;
+	char *end;
+	long n = strtol(q, &end, 10);
+	if(strcmp(q, "$") == 0){
+		editorJumpTo(E.numrows - 1);
+	}else if(end == q || (*end && strcmp(end, "%") != 0)){
+		editorSetStatusMessage("Not a line number : %.40s", q);
+	}else if(*end == '%'){
+		if(n < 0) n = 0;
+		if(n > 100) n = 100;
+		editorJumpTo(E.numrows > 0 ? (long long)(E.numrows - 1) * n / 100 : 0);
+	}else{
+		editorJumpTo(n < 1 ? 0 : n > E.numrows ? E.numrows - 1 : n - 1);
+	}
+	free(q);
+}
+
+
+
+
+void editorPaste(){								// after ESC[200~ : take everything up to ESC[201~ and insert it in one go
+	static const char end[] = "\x1b[201~";
+	char *p = NULL;								// the pasted text, len bytes of cap
+	int len = 0, cap = 0;
+	int matched = 0, idle = 0, cr = 0;
+	char c;
+	while(matched < 6){
+		if(!editorInputByte(&c)){					// the terminal should send the end marker, don't wait forever if it doesn't
+			if(++idle == 10) break;
+			continue;
+		}
+		idle = 0;
+		if(c == end[matched]){
+			matched++;
+			continue;
+		}
+		if(len + matched + 1 > cap){					// room for a false end marker and c
+			cap = cap ? cap * 2 : 4096;
+			p = realloc(p, cap);
+			if(p == NULL) die("realloc");
+		}
+		if(matched){							// it looked like the end marker but wasn't
+			memcpy(p + len, end, matched);
+			len += matched;
+			matched = c == end[0];
+			if(matched) continue;
+		}
+		if(c == '\n' && cr){						// terminals send \r for new lines, \r\n is one new line too
+			cr = 0;
+			continue;
+		}
+		cr = c == '\r';
+		if(cr) c = '\n';
+		p[len++] = c;
+	}
+	if(len > 0){
+		int er, ec;
+		editorUndoInsert(E.cy, E.cx, p, len);
+		editorInsertText(E.cy, E.cx, p, len, &er, &ec);
+		E.cy = er;
+		E.cx = ec;
+		editorUndoSeal();						// typing after the paste is another undo step
+	}
+	free(p);
+}
+
+
 void editorProcessKeypress(){												// function that maps the keypresses to our functionnalities, eg(ctrl+q = quit)
 	static int quit_times = MINOCH_QUIT_TIMES;			// number of times  u have to press ctrl-Q to quit when  u have unsaved changes !
 
 	int c = editorReadKey();	
+	if(c != BACKSPACE && c != CTRL_KEY('h') && (c > 255 || iscntrl(c)) && c != '\r' && c != '\t')
+		editorUndoSeal();						// anything but typing starts a new undo record (past 255 : the special keys)
 	switch(c){
 
 		case '\r':
@@ -719,8 +5098,13 @@ void editorProcessKeypress(){												// function that maps the keypresses to
 			return;
 		  }
 
-		  write(STDOUT_FILENO, "\x1b[2J",4);
-		  write(STDOUT_FILENO, "\x1b[H", 3);
+		  editorTermWrite("\x1b[2J",4);
+		  editorTermWrite("\x1b[H", 3);
+		  editorJournalClose();
+		  if(!editorRowsClose() && !E.bench.on){			// (headless runs report it with their numbers)
+			disableRawMode();					// back to a normal terminal first, or the message is lost
+			fprintf(stderr, "minoch: row memory accounting is off, something leaked\n");
+		  }
 		  exit(0);
 		  break;
 
@@ -728,6 +5112,34 @@ void editorProcessKeypress(){												// function that maps the keypresses to
 		case CTRL_KEY('s'):
 		  editorSave();
 		  break;	
+
+		case CTRL_KEY('f'):
+		  editorFind();
+		  break;
+
+		case CTRL_KEY('r'):
+		  editorReplace();
+		  break;
+
+		case CTRL_KEY('z'):
+		  editorUndo();
+		  break;
+
+		case CTRL_KEY('y'):
+		  editorRedo();
+		  break;
+
+		case CTRL_KEY('p'):
+		  E.perf.show = !E.perf.show;					// perf overlay in the message bar
+		  break;
+
+		case CTRL_KEY('t'):
+		  editorFollowToggle();
+		  break;
+
+		case CTRL_KEY('w'):
+		  editorWrapToggle();
+		  break;
 	
 		case BACKSPACE:
 		case CTRL_KEY('h'):	
@@ -737,12 +5149,25 @@ void editorProcessKeypress(){												// function that maps the keypresses to
 
 		case PAGE_UP:
 		case PAGE_DOWN:
-		  {
-			int times = E.screenrows;
-			while (times--)
-			  editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-		  }
+		  editorPage(c == PAGE_DOWN ? 1 : -1);				// O(1), O(log n) with soft wrap
 		  break;  
+
+		case CTRL_KEY('g'):
+		  editorGoto();
+		  break;
+
+		case FILE_START:
+		  editorJumpTo(0);
+		  break;
+
+		case FILE_END:
+		  editorJumpTo(E.numrows - 1);
+		  if(E.cy < E.numrows) E.cx = editorRowAt(E.cy)->size;
+		  break;
+
+		case CTRL_KEY('n'):
+		  E.linenums = !E.linenums;					// line number gutter, see editorGutterUpdate
+		  break;
 		 
 		  
 		case ARROW_UP:
@@ -752,8 +5177,16 @@ void editorProcessKeypress(){												// function that maps the keypresses to
 		  editorMoveCursor(c);
 		  break;
 	
-		case CTRL_KEY('l'):
 		case '\x1b':
+		  editorSearchStop();						// forget the last search (and its match count)
+		  break;
+
+		case CTRL_KEY('l'):
+		case PASTE_END:
+		  break;
+
+		case PASTE_START:
+		  editorPaste();
 		  break;
 		
 		default:
@@ -764,6 +5197,211 @@ void editorProcessKeypress(){												// function that maps the keypresses to
 }
 
 
+/**** Headless ****/
+
+/* minoch --headless script [--size RxC] [file] plays the bytes of script as if they were typed (escape sequences, pastes and
+ all) through the real editorProcessKeypress / editorRefreshScreen, with no terminal : getWindowSize returns the given size
+ and the output is only counted. every key is timed from the moment we read it to the end of its redraw.
+ minoch --bench [--size RxC] [lines] writes a file of lines rows (1000000 by default) and runs a few scripts on it, each in its
+ own process : typing, pasting, paging down to the end, saving. a run fails (exit status 2) if the row memory accounting is
+ off at the end, or if the redraw path still allocated during the second half of the script; --bench fails if any run did. */
+
+int editorBenchCompare(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+
+void editorBenchRecord(struct timespec *t0){
+	struct benchState *B = &E.bench;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if(B->nlat == B->latcap){
+		B->latcap = B->latcap ? B->latcap * 2 : 1024;
+		B->lat = realloc(B->lat, sizeof(double) * B->latcap);
+		if(B->lat == NULL) die("realloc");
+	}
+	B->lat[B->nlat++] = (t1.tv_sec - t0->tv_sec) * 1e6 + (t1.tv_nsec - t0->tv_nsec) / 1e3;
+	if(B->half_allocs == (unsigned long)-1 && B->pos >= B->len / 2) B->half_allocs = E.frame_allocs;
+}
+
+
+void editorBenchReport(){							// atexit : the numbers of the run
+	struct benchState *B = &E.bench;
+	unsigned long allocs = E.frame_allocs;
+	int fail = 0;
+	double p50 = 0, p90 = 0, p99 = 0, max = 0, total = 0;
+	if(B->nlat){
+		int j;
+		for(j = 0; j < B->nlat; j++) total += B->lat[j];
+		qsort(B->lat, B->nlat, sizeof(double), editorBenchCompare);
+		p50 = B->lat[B->nlat / 2];
+		p90 = B->lat[(int)(B->nlat * 0.9)];
+		p99 = B->lat[(int)(B->nlat * 0.99)];
+		max = B->lat[B->nlat - 1];
+	}
+	editorJournalClose();						// a scripted run is not a session to recover
+	editorRowsClose();
+	printf("%-10s %7d keys  p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  max %9.1f us  total %8.1f ms  out %9.1f KB",
+		B->name, B->nlat, p50, p90, p99, max, total / 1e3, B->out / 1024.0);
+	if(E.rowmem.leaks){
+		printf("  ROW MEMORY LEAK");
+		fail = 1;
+	}
+	if(B->half_allocs != (unsigned long)-1 && allocs > B->half_allocs){
+		printf("  FRAME ALLOCS %lu -> %lu", B->half_allocs, allocs);
+		fail = 1;
+	}
+	printf("\n");
+	fflush(stdout);
+	if(fail) _exit(2);
+}
+
+
+void editorBenchLoop(){								// main loop of a headless run, ends with the script
+	atexit(editorBenchReport);
+	editorRefreshScreen();
+	while(1){
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		editorProcessKeypress();
+		editorRefreshScreen();						// one redraw per key, that is what we time
+		editorBenchRecord(&t0);
+	}
+}
+
+
+void editorBenchKeys(struct abuf *ab, const char *keys, int len, int times){
+	while(times-- > 0) abAppend(ab, keys, len);
+}
+
+
+int editorBenchCheckLongRow(const char *path, const char *typed, int len, int times, int pasted){	// the first row of the file
+	FILE *fp = fopen(path, "r");							// starts with typed (times times),
+	if(fp == NULL) return 0;							// then pasted 'a's ?
+	int ok = 1, j, k;
+	for(j = 0; j < times && ok; j++)
+		for(k = 0; k < len && ok; k++) ok = fgetc(fp) == (unsigned char)typed[k];
+	for(j = 0; j < pasted && ok; j++) ok = fgetc(fp) == 'a';
+	fclose(fp);
+	return ok;
+}
+
+
+void editorBenchSuite(int lines){
+	char path[] = "/tmp/minoch-bench-XXXXXX.c";				// .c : the scenarios run with highlighting on
+	int fd = mkstemps(path, 2);
+	if(fd == -1) die("mkstemps");
+	FILE *fp = fdopen(fd, "w");
+	if(fp == NULL) die("fdopen");
+	int j;
+	for(j = 0; j < lines; j++){						// C looking rows of different lengths, some tabs
+		if(j % 10 == 0) fprintf(fp, "/* block %d */\n", j / 10);
+		else fprintf(fp, "%.*sif(x%d > %d) total += f(x%d, \"%d\"); // row %d\n", j % 4, "\t\t\t", j, j % 97, j % 13, j, j);
+	}
+	if(fclose(fp) == EOF) die("fclose");
+
+	struct abuf scripts[7] = { ABUF_INIT, ABUF_INIT, ABUF_INIT, ABUF_INIT, ABUF_INIT, ABUF_INIT, ABUF_INIT };
+	const char *names[7] = { "typing", "paste", "pagedown", "save", "goto", "replace", "longrow" };
+	editorBenchKeys(&scripts[0], "\x1b[6~", 4, 10);				// typing : 3000 keys in the middle of the file
+	for(j = 0; j < 3000; j++){
+		char c = j % 50 == 49 ? '\r' : j % 13 == 12 ? BACKSPACE : 'a' + j % 26;
+		abAppend(&scripts[0], &c, 1);
+	}
+	for(j = 0; j < 4; j++){							// paste : 4 pastes of 10000 lines
+		int k;
+		char buf[64];
+		abAppend(&scripts[1], "\x1b[200~", 6);
+		for(k = 0; k < 10000; k++){
+			int n = snprintf(buf, sizeof(buf), "\tpasted(%d, %d);\r", j, k);
+			abAppend(&scripts[1], buf, n);
+		}
+		abAppend(&scripts[1], "\x1b[201~", 6);
+		editorBenchKeys(&scripts[1], "\x1b[6~", 4, 3);
+	}
+	editorBenchKeys(&scripts[2], "\x1b[6~", 4, lines / (E.bench.rows - 2) + 2);	// pagedown : to the end of the file
+	editorBenchKeys(&scripts[3], "x\x13", 2, 5);				// save : type a char, Ctrl-S, five times
+	editorBenchKeys(&scripts[4], "\x0e", 1, 1);				// goto : with line numbers, jump to the end, the middle,
+	editorBenchKeys(&scripts[4], "\x07$\r\x07" "50%\r\x07" "1\r\x1b[1;5F\x1b[1;5H", 23, 40);	// line 1, then Ctrl-End / Ctrl-Home
+	editorBenchKeys(&scripts[5], "\x12total\rsum\r\x1a\x19", 13, 3);		// replace : replace-all on every row, undo, redo
+	editorBenchKeys(&scripts[6], "\x1b[1;5H\x1b[200~", 12, 1);		// longrow : paste 70000 chars in front of the first row,
+	editorBenchKeys(&scripts[6], "a", 1, 70000);				// go back to its start, type utf-8 text there and save
+	editorBenchKeys(&scripts[6], "\x1b[201~\x1b[1;5H", 12, 1);
+	editorBenchKeys(&scripts[6], "XY\xc3\xa9Z\xe4\xb8\xad", 8, 100);
+	editorBenchKeys(&scripts[6], "\x13", 1, 1);
+
+	int failed = 0;
+	for(j = 0; j < 7; j++){
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid == -1) die("fork");
+		if(pid == 0){							// the child opens the file and plays its script
+			E.bench.name = names[j];
+			E.bench.script = scripts[j].b;
+			E.bench.len = scripts[j].len;
+			initEditor();
+			editorOpen(path);
+			editorBenchLoop();
+		}
+		int status;
+		if(waitpid(pid, &status, 0) == -1) die("waitpid");
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+			printf("%-10s FAILED (status %d)\n", names[j], status);
+			failed++;
+		}else if(j == 6 && !editorBenchCheckLongRow(path, "XY\xc3\xa9Z\xe4\xb8\xad", 8, 100, 70000)){
+			printf("%-10s FAILED (the saved row is not what was typed)\n", names[j]);
+			failed++;
+		}
+	}
+	unlink(path);
+	printf("%d lines, %d scenarios, %d failed\n", lines, 7, failed);
+	exit(failed ? 2 : 0);
+}
+
+
+char *editorBenchArgs(int argc, char *argv[]){					// --headless / --bench; returns the file to open
+	char *script = NULL, *file = NULL;
+	int bench = 0, lines = 1000000, j;
+	E.bench.rows = 24;
+	E.bench.cols = 80;
+	E.bench.half_allocs = -1;
+	for(j = 1; j < argc; j++){
+		if(strcmp(argv[j], "--headless") == 0 && j + 1 < argc) script = argv[++j];
+		else if(strcmp(argv[j], "--bench") == 0) bench = 1;
+		else if(strcmp(argv[j], "--size") == 0 && j + 1 < argc){
+			if(sscanf(argv[++j], "%dx%d", &E.bench.rows, &E.bench.cols) != 2 || E.bench.rows < 3 || E.bench.cols < 1){
+				fprintf(stderr, "minoch: --size wants ROWSxCOLS\n");
+				exit(1);
+			}
+		}
+		else if(bench) lines = atoi(argv[j]) > 0 ? atoi(argv[j]) : lines;
+		else file = argv[j];
+	}
+	E.bench.on = 1;
+	if(bench) editorBenchSuite(lines);
+	if(script == NULL){
+		fprintf(stderr, "usage: minoch --headless script [--size RxC] [file]\n       minoch --bench [--size RxC] [lines]\n");
+		exit(1);
+	}
+	int fd = open(script, O_RDONLY);
+	struct stat st;
+	if(fd == -1 || fstat(fd, &st) == -1) die(script);
+	E.bench.script = malloc(st.st_size + 1);
+	if(E.bench.script == NULL) die("malloc");
+	size_t got = 0;
+	while(got < (size_t)st.st_size){
+		ssize_t n = read(fd, E.bench.script + got, st.st_size - got);
+		if(n <= 0) die("read");
+		got += n;
+	}
+	close(fd);
+	E.bench.len = got;
+	E.bench.name = "headless";
+	return file;
+}
+
+
+
 /**** Initializing ****/
 
 void initEditor(){
@@ -774,15 +5412,77 @@ E.rowoff = 0;
 E.coloff = 0;
 E.numrows = 0;
 E.row = NULL;
+E.rowcap = 0;
+E.gap = 0;
+E.rowversion = 0;
+E.rcache = NULL;
+E.rcachelen = 0;
+E.frame = NULL;
+E.framelines = 0;
+E.frame_cx = E.frame_cy = -1;
+E.ob = (struct abuf) ABUF_INIT;
+E.lb = (struct abuf) ABUF_INIT;
+E.frame_allocs = 0;
 E.dirty = 0;
 E.filename = NULL;
+E.map = NULL;
+E.mapsize = 0;
+E.mapfd = -1;
+E.match_len = 0;
+E.syntax = NULL;
+E.lrow = NULL;
+E.hl_clean = E.hl_high = 0;
+E.hl_dirty_hi = -1;
+memset(&E.search, 0, sizeof(E.search));
+memset(&E.undo, 0, sizeof(E.undo));
+memset(&E.wrap, 0, sizeof(E.wrap));
+E.journal.fd = -1;
+E.journal.last = (size_t)-1;
+pthread_mutex_init(&E.journal.lock, NULL);
+pthread_mutex_init(&E.journal.iolock, NULL);
+pthread_cond_init(&E.journal.wake, NULL);
+pthread_mutex_init(&E.search.lock, NULL);
+pthread_cond_init(&E.search.progress, NULL);
+memset(&E.pool, 0, sizeof(E.pool));
+pthread_mutex_init(&E.pool.lock, NULL);
+pthread_cond_init(&E.pool.wake, NULL);
+pthread_cond_init(&E.pool.idle, NULL);
+pthread_rwlockattr_t rwattr;
+pthread_rwlockattr_init(&rwattr);
+pthread_rwlockattr_setkind_np(&rwattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);	// edits must not wait behind a stream of readers
+pthread_rwlock_init(&E.rowlock, &rwattr);
+pthread_rwlock_wrlock(&E.rowlock);
 E.statusmsg[0] = '\0';
 E.statusmsg_time = 0;
 
-if(getWindowSize(&E.screenrows, &E.screencols) == -1) die("getWindowSize");
+sigset_t winch;													// SIGWINCH is blocked (before any thread starts, they inherit it) and read from a signalfd
+sigemptyset(&winch);
+sigaddset(&winch, SIGWINCH);
+if(sigprocmask(SIG_BLOCK, &winch, NULL) == -1) die("sigprocmask");
+if((E.sigfd = signalfd(-1, &winch, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) die("signalfd");
+if((E.timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) die("timerfd_create");
+if((E.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) die("eventfd");
+
+if(getWindowSize(&E.screenrows, &E.termcols) == -1) die("getWindowSize");
 
 E.screenrows -= 2;
+E.linenums = 0;
+editorGutterUpdate();
+editorRenderCacheResize(E.screenrows * 2 > MINOCH_RENDER_CACHE ? E.screenrows * 2 : MINOCH_RENDER_CACHE);
+editorFrameResize(E.screenrows + 2);
+
+}
 
+
+void editorResize(){										// the window changed size : resize what depends on it, repaint everything
+	int rows, cols;
+	if(getWindowSize(&rows, &cols) == -1) return;
+	E.screenrows = rows - 2 > 1 ? rows - 2 : 1;
+	E.termcols = cols;
+	editorGutterUpdate();
+	int cache = E.screenrows * 2 > MINOCH_RENDER_CACHE ? E.screenrows * 2 : MINOCH_RENDER_CACHE;
+	if(cache > E.rcachelen) editorRenderCacheResize(cache);
+	editorFrameResize(E.screenrows + 2);
 }
 
 
@@ -791,20 +5491,37 @@ E.screenrows -= 2;
 /**** Main function****/ 
 
 int main(int argc, char *argv[]){
-	enableRawMode();
+	if(argc >= 3 && strcmp(argv[1], "--perf-log") == 0){			// histograms of the perf overlay go there at exit
+		E.perf.log = argv[2];
+		atexit(editorPerfDump);
+		argv += 2;
+		argc -= 2;
+	}
+	int follow = 0;
+	if(argc >= 3 && strcmp(argv[1], "-f") == 0){				// follow the file from the start, like tail -f
+		follow = 1;
+		argv++;
+		argc--;
+	}
+	char *file = argc >= 2 ? argv[1] : NULL;
+	if(file && strncmp(file, "--", 2) == 0) file = editorBenchArgs(argc, argv);	// headless runs, see Headless
+	if(!E.bench.on) enableRawMode();
 	initEditor();
 
-	if(argc >= 2){
-	  	editorOpen(argv[1]);
+	if(file){
+	  	editorOpen(file);
 	}
+	if(follow) editorFollowToggle();
 
-	editorSetStatusMessage("*** HELP: Ctrl-S = Save | Ctrl-Q = Exit");
+	if(E.statusmsg[0] == '\0')						// big files show how fast they loaded instead
+		editorSetStatusMessage("*** HELP: Ctrl-S = Save | Ctrl-Q = Exit | Ctrl-F = Find | Ctrl-Z/Y = Undo/Redo");
+	if(E.bench.on) editorBenchLoop();
 
 
 	while(1){
 	    editorRefreshScreen();
-   	    editorProcessKeypress();
-	
+   	    do editorProcessKeypress();
+   	    while(editorInputPending());					// every key already typed (or pasted) is handled before we redraw
 	}
 return 0;	
 }